@@ -8,6 +8,7 @@
 
 #include <linux/types.h>
 #include <linux/v4l2-controls.h>
+#include <linux/videodev2.h>
 
 /* vendor color format start */
 /* UBWC 8-bit Y/CbCr 4:2:0  */
@@ -43,6 +44,36 @@
 #define V4L2_CMD_FLUSH_CAPTURE                      (1 << 1)
 /* Vendor commands end */
 
+/* Vendor ioctls start */
+struct msm_vidc_prepare_plane {
+	__s32 fd;
+	__u32 length;
+};
+
+/*
+ * Imports and maps the @num_planes planes of buffer @index of queue
+ * @type ahead of its first qbuf. Unlike VIDIOC_PREPARE_BUF it does not
+ * latch the buffer state in vb2, so the qbuf still carries per-frame
+ * bytesused and flags. The client must not write to prepared encoder
+ * capture buffers with the CPU: on requeue only the bytes returned by
+ * their last dqbuf are invalidated.
+ *
+ * The struct carries no pointers and has the same layout for 32 and
+ * 64 bit clients.
+ */
+struct msm_vidc_prepare_buf {
+	__u32 type;
+	__u32 memory;
+	__u32 index;
+	__u32 num_planes;
+	struct msm_vidc_prepare_plane planes[VIDEO_MAX_PLANES];
+	__u32 reserved[4];
+};
+
+#define VIDIOC_MSM_VIDC_PREPARE_BUF \
+		_IOW('V', BASE_VIDIOC_PRIVATE + 0, struct msm_vidc_prepare_buf)
+/* Vendor ioctls end */
+
 /* Vendor events start */
 #define V4L2_EVENT_MSM_VIDC_START \
 		(V4L2_EVENT_PRIVATE_START + 0x00001000)
@@ -50,6 +81,15 @@
 		(V4L2_EVENT_MSM_VIDC_START + 1)
 #define V4L2_EVENT_MSM_VIDC_PORT_SETTINGS_CHANGED_SUFFICIENT \
 		(V4L2_EVENT_MSM_VIDC_START + 2)
+/*
+ * Decoders raise PORT_SETTINGS_CHANGED_INSUFFICIENT on a reconfig. An
+ * encoder with adaptive bitstream sizing raises it once for its capture
+ * port when a frame overflowed a buffer sized below the worst case: the
+ * truncated frame is dequeued with V4L2_BUF_FLAG_DATA_CORRUPT and encoder
+ * clients that subscribe should reallocate the capture buffers to the
+ * G_FMT sizeimage. The payload carries MSM_VIDC_HEIGHT, MSM_VIDC_WIDTH
+ * and MSM_VIDC_FW_MIN_COUNT.
+ */
 #define V4L2_EVENT_MSM_VIDC_PORT_SETTINGS_CHANGED_INSUFFICIENT \
 		(V4L2_EVENT_MSM_VIDC_START + 3)
 #define V4L2_EVENT_MSM_VIDC_SYS_ERROR \
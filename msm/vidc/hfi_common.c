@@ -41,15 +41,24 @@ const struct msm_vidc_bus_data DEFAULT_BUS_VOTE = {
 		(b) - (a) < TRIVIAL_BW_THRESHOLD)
 
 const int max_packets = 480; /* 16 sessions x 30 packets */
+/* responses other than ETB/FBD done handled per drain round */
+const int max_info_packets = 32;
+
+/* sleep between message queue polls while under load */
+#define VIDC_MSGQ_POLL_INTERVAL_US 100
+#define VIDC_MSGQ_MAX_PENDING_ROUNDS 8
 
 static void venus_hfi_pm_handler(struct work_struct *work);
 static DECLARE_DELAYED_WORK(venus_hfi_pm_work, venus_hfi_pm_handler);
+static void venus_hfi_resume_handler(struct work_struct *work);
+static DECLARE_DELAYED_WORK(venus_hfi_resume_work, venus_hfi_resume_handler);
 static inline int __resume(struct venus_hfi_device *device, u32 sid);
 static inline int __suspend(struct venus_hfi_device *device);
 static int __enable_regulators(struct venus_hfi_device *device, u32 sid);
 static inline int __prepare_enable_clks(
 		struct venus_hfi_device *device, u32 sid);
 static void __flush_debug_queue(struct venus_hfi_device *device, u8 *packet);
+static struct work_struct venus_hfi_work;
 static int __initialize_packetization(struct venus_hfi_device *device);
 static struct hal_session *__get_session(struct venus_hfi_device *device,
 		u32 sid);
@@ -169,10 +178,49 @@ void __dump(struct dump dump[], int len, u32 sid)
 
 static inline void __strict_check(struct venus_hfi_device *device)
 {
+	lockdep_assert_held(&device->lock);
 	msm_vidc_res_handle_fatal_hw_error(device->res,
 		!mutex_is_locked(&device->lock));
 }
 
+static void __hal_mutex_lock(struct mutex *lock, struct hal_lock_stats *stats)
+{
+	u64 start_ns;
+	u32 wait_us;
+
+	if (mutex_trylock(lock)) {
+		stats->acquired++;
+		return;
+	}
+
+	start_ns = ktime_get_ns();
+	mutex_lock(lock);
+	wait_us = div_u64(ktime_get_ns() - start_ns, NSEC_PER_USEC);
+
+	stats->acquired++;
+	stats->contended++;
+	stats->wait_us += wait_us;
+	stats->max_wait_us = max(stats->max_wait_us, wait_us);
+}
+
+static inline void __lock_device(struct venus_hfi_device *device)
+{
+	__hal_mutex_lock(&device->lock,
+		&device->pm_stats.locks[HAL_LOCK_DEVICE]);
+}
+
+static inline void __lock_resp(struct venus_hfi_device *device)
+{
+	__hal_mutex_lock(&device->resp_lock,
+		&device->pm_stats.locks[HAL_LOCK_RESP]);
+}
+
+static inline void __lock_res(struct venus_hfi_device *device)
+{
+	__hal_mutex_lock(&device->res_lock,
+		&device->pm_stats.locks[HAL_LOCK_RES]);
+}
+
 static inline void __set_state(struct venus_hfi_device *device,
 		enum venus_hfi_state state)
 {
@@ -184,6 +232,26 @@ static inline bool __core_in_valid_state(struct venus_hfi_device *device)
 	return device->state != VENUS_STATE_DEINIT;
 }
 
+/*
+ * The response path only holds resp_lock, so it can't touch registers: the
+ * pm worker may collapse the core at any time. Doorbells it owes venus
+ * (tx_req set on a queue it read) are recorded and rung from here, under
+ * device->lock.
+ */
+static void __ring_deferred_doorbell(struct venus_hfi_device *device)
+{
+	lockdep_assert_held(&device->lock);
+
+	if (!atomic_xchg(&device->doorbell_pending, 0))
+		return;
+
+	/* a collapsed core has saved its queues, nothing is waiting */
+	if (!device->power_enabled || !__core_in_valid_state(device))
+		return;
+
+	call_venus_op(device, raise_interrupt, device, DEFAULT_SID);
+}
+
 static inline bool is_sys_cache_present(struct venus_hfi_device *device)
 {
 	return device->res->sys_cache_present;
@@ -346,7 +414,7 @@ static int venus_hfi_session_pause(void *sess)
 	struct hal_session *session = sess;
 	struct venus_hfi_device *device = &venus_hfi_dev;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __session_pause(device, session);
 	mutex_unlock(&device->lock);
 
@@ -359,7 +427,7 @@ static int venus_hfi_session_resume(void *sess)
 	struct hal_session *session = sess;
 	struct venus_hfi_device *device = &venus_hfi_dev;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __session_resume(device, session);
 	mutex_unlock(&device->lock);
 
@@ -444,13 +512,25 @@ err_reg_handoff_failed:
 	return rc;
 }
 
+static void __iface_q_ring(struct vidc_iface_q_info *qinfo,
+		struct hfi_ring *ring)
+{
+	struct hfi_queue_header *queue =
+		(struct hfi_queue_header *)qinfo->q_hdr;
+
+	hfi_ring_init(ring, qinfo->q_array.align_virtual_addr,
+		qinfo->q_array.mem_size, &queue->qhdr_read_idx,
+		&queue->qhdr_write_idx);
+}
+
 static int __write_queue(struct vidc_iface_q_info *qinfo, u8 *packet,
 		bool *rx_req_is_set, u32 sid)
 {
 	struct hfi_queue_header *queue;
-	u32 packet_size_in_words, new_write_idx;
-	u32 empty_space, read_idx, write_idx;
-	u32 *write_ptr;
+	struct hfi_ring ring;
+	struct hfi_ring_span span;
+	u32 packet_size_in_words;
+	int rc;
 
 	if (!qinfo || !packet) {
 		s_vpr_e(sid, "%s: invalid params %pK %pK\n",
@@ -472,62 +552,38 @@ static int __write_queue(struct vidc_iface_q_info *qinfo, u8 *packet,
 		__dump_packet(packet, sid);
 	}
 
+	__iface_q_ring(qinfo, &ring);
 	packet_size_in_words = (*(u32 *)packet) >> 2;
-	if (!packet_size_in_words || packet_size_in_words >
-		qinfo->q_array.mem_size>>2) {
+	if (!packet_size_in_words || packet_size_in_words > ring.size) {
 		s_vpr_e(sid, "Invalid packet size\n");
 		return -ENODATA;
 	}
 
-	read_idx = queue->qhdr_read_idx;
-	write_idx = queue->qhdr_write_idx;
-
-	empty_space = (write_idx >=  read_idx) ?
-		((qinfo->q_array.mem_size>>2) - (write_idx -  read_idx)) :
-		(read_idx - write_idx);
-	if (empty_space <= packet_size_in_words) {
+	rc = hfi_ring_reserve(&ring, packet_size_in_words, &span);
+	if (rc == -EINVAL) {
+		s_vpr_e(sid, "Invalid write index");
+		return -ENODATA;
+	} else if (rc) {
 		queue->qhdr_tx_req =  1;
 		s_vpr_e(sid, "Insufficient size (%d) to write (%d)\n",
-					  empty_space, packet_size_in_words);
+			ring.size - hfi_ring_used(&ring, queue->qhdr_read_idx,
+				queue->qhdr_write_idx),
+			packet_size_in_words);
 		return -ENOTEMPTY;
 	}
 
 	queue->qhdr_tx_req =  0;
 
-	new_write_idx = write_idx + packet_size_in_words;
-	write_ptr = (u32 *)((qinfo->q_array.align_virtual_addr) +
-			(write_idx << 2));
-	if (write_ptr < (u32 *)qinfo->q_array.align_virtual_addr ||
-	    write_ptr > (u32 *)(qinfo->q_array.align_virtual_addr +
-	    qinfo->q_array.mem_size)) {
-		s_vpr_e(sid, "Invalid write index");
-		return -ENODATA;
-	}
-
-	if (new_write_idx < (qinfo->q_array.mem_size >> 2)) {
-		memcpy(write_ptr, packet, packet_size_in_words << 2);
-	} else {
-		new_write_idx -= qinfo->q_array.mem_size >> 2;
-		memcpy(write_ptr, packet, (packet_size_in_words -
-			new_write_idx) << 2);
-		memcpy((void *)qinfo->q_array.align_virtual_addr,
-			packet + ((packet_size_in_words - new_write_idx) << 2),
-			new_write_idx  << 2);
-	}
+	hfi_ring_write(&ring, &span, packet);
+	hfi_ring_commit(&ring, &span);
 
 	/*
-	 * Memory barrier to make sure packet is written before updating the
-	 * write index
+	 * Memory barrier to make sure write index is updated before an
+	 * interrupt is raised on venus, and before rx_req is sampled.
 	 */
 	mb();
-	queue->qhdr_write_idx = new_write_idx;
 	if (rx_req_is_set)
 		*rx_req_is_set = queue->qhdr_rx_req == 1;
-	/*
-	 * Memory barrier to make sure write index is updated before an
-	 * interrupt is raised on venus.
-	 */
-	mb();
 	return 0;
 }
 
@@ -537,6 +593,7 @@ static void __hal_sim_modify_msg_packet(u8 *packet,
 	struct hfi_msg_sys_session_init_done_packet *init_done;
 	struct hal_session *session = NULL;
 	phys_addr_t fw_bias = 0;
+	bool is_decoder;
 
 	if (!device || !packet) {
 		d_vpr_e("%s: invalid params %pK %pK\n",
@@ -549,7 +606,10 @@ static void __hal_sim_modify_msg_packet(u8 *packet,
 
 	fw_bias = device->hal_data->firmware_base;
 	init_done = (struct hfi_msg_sys_session_init_done_packet *)packet;
+	rcu_read_lock();
 	session = __get_session(device, init_done->sid);
+	is_decoder = session && session->is_decoder;
+	rcu_read_unlock();
 	if (!session) {
 		d_vpr_e("%s: Invalid session id: %x\n",
 				__func__, init_done->sid);
@@ -558,7 +618,7 @@ static void __hal_sim_modify_msg_packet(u8 *packet,
 
 	switch (init_done->packet_type) {
 	case HFI_MSG_SESSION_FILL_BUFFER_DONE:
-		if (session->is_decoder) {
+		if (is_decoder) {
 			struct
 			hfi_msg_session_fbd_uncompressed_plane0_packet
 			*pkt_uc = (struct
@@ -590,8 +650,8 @@ static int __read_queue(struct vidc_iface_q_info *qinfo, u8 *packet,
 		u32 *pb_tx_req_is_set)
 {
 	struct hfi_queue_header *queue;
+	struct hfi_ring ring;
 	u32 packet_size_in_words, new_read_idx;
-	u32 *read_ptr;
 	u32 receive_request = 0;
 	u32 read_idx, write_idx;
 	int rc = 0;
@@ -606,11 +666,6 @@ static int __read_queue(struct vidc_iface_q_info *qinfo, u8 *packet,
 		return -EINVAL;
 	}
 
-	/*
-	 * Memory barrier to make sure data is valid before
-	 *reading it
-	 */
-	mb();
 	queue = (struct hfi_queue_header *) qinfo->q_hdr;
 
 	if (!queue) {
@@ -629,10 +684,12 @@ static int __read_queue(struct vidc_iface_q_info *qinfo, u8 *packet,
 	if (queue->qhdr_type & HFI_Q_ID_CTRL_TO_HOST_MSG_Q)
 		receive_request = 1;
 
-	read_idx = queue->qhdr_read_idx;
-	write_idx = queue->qhdr_write_idx;
-
-	if (read_idx == write_idx) {
+	__iface_q_ring(qinfo, &ring);
+	rc = hfi_ring_peek(&ring, &read_idx, &write_idx);
+	if (rc == -EINVAL) {
+		d_vpr_e("Invalid read index\n");
+		return -ENODATA;
+	} else if (rc) {
 		queue->qhdr_rx_req = receive_request;
 		/*
 		 * mb() to ensure qhdr is updated in main memory
@@ -648,36 +705,15 @@ static int __read_queue(struct vidc_iface_q_info *qinfo, u8 *packet,
 		return -ENODATA;
 	}
 
-	read_ptr = (u32 *)((qinfo->q_array.align_virtual_addr) +
-				(read_idx << 2));
-	if (read_ptr < (u32 *)qinfo->q_array.align_virtual_addr ||
-	    read_ptr > (u32 *)(qinfo->q_array.align_virtual_addr +
-	    qinfo->q_array.mem_size - sizeof(*read_ptr))) {
-		d_vpr_e("Invalid read index\n");
-		return -ENODATA;
-	}
-
-	packet_size_in_words = (*read_ptr) >> 2;
+	packet_size_in_words = (*hfi_ring_ptr(&ring, read_idx)) >> 2;
 	if (!packet_size_in_words) {
 		d_vpr_e("Zero packet size\n");
 		return -ENODATA;
 	}
 
-	new_read_idx = read_idx + packet_size_in_words;
-	if (((packet_size_in_words << 2) <= VIDC_IFACEQ_VAR_HUGE_PKT_SIZE) &&
-		read_idx <= (qinfo->q_array.mem_size >> 2)) {
-		if (new_read_idx < (qinfo->q_array.mem_size >> 2)) {
-			memcpy(packet, read_ptr,
-					packet_size_in_words << 2);
-		} else {
-			new_read_idx -= (qinfo->q_array.mem_size >> 2);
-			memcpy(packet, read_ptr,
-			(packet_size_in_words - new_read_idx) << 2);
-			memcpy(packet + ((packet_size_in_words -
-					new_read_idx) << 2),
-					(u8 *)qinfo->q_array.align_virtual_addr,
-					new_read_idx << 2);
-		}
+	if ((packet_size_in_words << 2) <= VIDC_IFACEQ_VAR_HUGE_PKT_SIZE) {
+		new_read_idx = hfi_ring_read(&ring, read_idx, packet,
+			packet_size_in_words);
 	} else {
 		d_vpr_e("BAD packet received, read_idx: %#x, pkt_size: %d\n",
 			read_idx, packet_size_in_words << 2);
@@ -691,16 +727,16 @@ static int __read_queue(struct vidc_iface_q_info *qinfo, u8 *packet,
 	else
 		queue->qhdr_rx_req = receive_request;
 
-	queue->qhdr_read_idx = new_read_idx;
+	hfi_ring_consume(&ring, new_read_idx);
 	/*
-	 * mb() to ensure qhdr is updated in main memory
-	 * so that venus reads the updated header values
+	 * mb() to ensure rx_req and the read index are updated in main
+	 * memory before tx_req is sampled below
 	 */
 	mb();
 
 	*pb_tx_req_is_set = (queue->qhdr_tx_req == 1) ? 1 : 0;
 
-	if ((msm_vidc_debug & VIDC_PKT) &&
+	if (!rc && (msm_vidc_debug & VIDC_PKT) &&
 		!(queue->qhdr_type & HFI_Q_ID_CTRL_TO_HOST_DEBUG_Q)) {
 		sid = *((u32 *)packet + 2);
 		s_vpr_t(sid, "%s: %pK\n", __func__, qinfo);
@@ -900,6 +936,7 @@ int __unvote_buses(struct venus_hfi_device *device, u32 sid)
 	int rc = 0;
 	struct bus_info *bus = NULL;
 
+	__lock_res(device);
 	device->bus_vote = DEFAULT_BUS_VOTE;
 
 	venus_hfi_for_each_bus(device, bus) {
@@ -909,6 +946,7 @@ int __unvote_buses(struct venus_hfi_device *device, u32 sid)
 	}
 
 err_unknown_device:
+	mutex_unlock(&device->res_lock);
 	return rc;
 }
 
@@ -920,6 +958,8 @@ static int __vote_buses(struct venus_hfi_device *device,
 	unsigned long ab_kbps = 0, ib_kbps = 0, bw_prev = 0;
 	enum vidc_bus_type type;
 
+	lockdep_assert_held(&device->res_lock);
+
 	venus_hfi_for_each_bus(device, bus) {
 		if (bus && bus->path) {
 			type = get_type_frm_name(bus->name);
@@ -972,9 +1012,18 @@ static int venus_hfi_vote_buses(void *dev, unsigned long bw_ddr,
 	if (!device)
 		return -EINVAL;
 
-	mutex_lock(&device->lock);
+	__lock_res(device);
+	/* first vote after a restored one tells whether it was enough */
+	if (device->restored_bus_vote.total_bw_ddr) {
+		if (bw_ddr > device->restored_bus_vote.total_bw_ddr ||
+			bw_llcc > device->restored_bus_vote.total_bw_llcc)
+			device->pm_stats.bus_restore_low++;
+		device->restored_bus_vote = DEFAULT_BUS_VOTE;
+	}
+	device->last_bus_vote.total_bw_ddr = bw_ddr;
+	device->last_bus_vote.total_bw_llcc = bw_llcc;
 	rc = __vote_buses(device, bw_ddr, bw_llcc, sid);
-	mutex_unlock(&device->lock);
+	mutex_unlock(&device->res_lock);
 
 	return rc;
 }
@@ -1066,7 +1115,7 @@ static int venus_hfi_suspend(void *dev)
 	}
 
 	d_vpr_h("Suspending Venus\n");
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __power_collapse(device, true);
 	if (rc) {
 		d_vpr_e("%s: Venus is busy\n", __func__);
@@ -1075,8 +1124,10 @@ static int venus_hfi_suspend(void *dev)
 	mutex_unlock(&device->lock);
 
 	/* Cancel pending delayed works if any */
-	if (!rc)
+	if (!rc) {
 		cancel_delayed_work(&venus_hfi_pm_work);
+		cancel_delayed_work(&venus_hfi_resume_work);
+	}
 
 	return rc;
 }
@@ -1091,7 +1142,7 @@ static int venus_hfi_flush_debug_queue(void *dev)
 		return -EINVAL;
 	}
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	if (!device->power_enabled) {
 		d_vpr_e("%s: venus power off\n", __func__);
 		rc = -EINVAL;
@@ -1153,6 +1204,8 @@ static int __set_clocks(struct venus_hfi_device *device, u32 freq, u32 sid)
 	struct clock_info *cl;
 	int rc = 0;
 
+	lockdep_assert_held(&device->res_lock);
+
 	/* bail early if requested clk_freq is not changed */
 	if (freq == device->clk_freq)
 		return 0;
@@ -1182,17 +1235,17 @@ static int venus_hfi_scale_clocks(void *dev, u32 freq, u32 sid)
 		return -EINVAL;
 	}
 
-	mutex_lock(&device->lock);
-
-	if (__resume(device, sid)) {
-		s_vpr_e(sid, "Resume from power collapse failed\n");
-		rc = -ENODEV;
+	/* don't wake the core or wait behind power collapse just for this */
+	__lock_res(device);
+	if (!device->clks_enabled) {
+		/* applied by __scale_clocks() on the next power on */
+		device->clk_freq_pending = freq;
 		goto exit;
 	}
 
 	rc = __set_clocks(device, freq, sid);
 exit:
-	mutex_unlock(&device->lock);
+	mutex_unlock(&device->res_lock);
 
 	return rc;
 }
@@ -1206,11 +1259,169 @@ static int __scale_clocks(struct venus_hfi_device *device, u32 sid)
 	allowed_clks_tbl = device->res->allowed_clks_tbl;
 	rate = device->clk_freq ? device->clk_freq :
 		allowed_clks_tbl[0].clock_rate;
+	if (device->clk_freq_pending)
+		rate = device->clk_freq_pending;
+	device->clk_freq_pending = 0;
 
 	rc = __set_clocks(device, rate, sid);
 	return rc;
 }
 
+static void __schedule_power_collapse(struct venus_hfi_device *device,
+		u32 delay_ms, u32 sid)
+{
+	if (!device->res->sw_power_collapsible)
+		return;
+
+	cancel_delayed_work(&venus_hfi_pm_work);
+	if (!queue_delayed_work(device->venus_pm_workq,
+			&venus_hfi_pm_work, msecs_to_jiffies(delay_ms)))
+		s_vpr_l(sid, "PM work already scheduled\n");
+}
+
+static u64 __pc_breakeven_ns(struct venus_hfi_device *device)
+{
+	u64 breakeven_us = (u64)device->pm_stats.resume_avg_us *
+		VIDC_PC_BREAKEVEN_FACTOR;
+
+	return max_t(u64, breakeven_us, VIDC_PC_MIN_BREAKEVEN_US) *
+		NSEC_PER_USEC;
+}
+
+/*
+ * Returns the earliest time at which one of the sessions is expected to
+ * queue its next input, U64_MAX if no session has a usable cadence.
+ */
+static u64 __next_expected_etb_ns(struct venus_hfi_device *device,
+		u64 curr_time_ns, u32 *etb_pending)
+{
+	struct hal_session *session;
+	u64 expected_ns, next_ns = U64_MAX;
+
+	list_for_each_entry(session, &device->sess_head, list) {
+		if (!session->etb_interval_ns)
+			continue;
+
+		/* ignore sessions which stopped queueing input */
+		expected_ns = session->last_etb_ns + session->etb_interval_ns;
+		if (curr_time_ns > expected_ns + session->etb_interval_ns)
+			continue;
+
+		*etb_pending += atomic_read(&session->etb_pending);
+		next_ns = min(next_ns, expected_ns);
+	}
+
+	return next_ns;
+}
+
+/*
+ * Picks the power collapse delay from the input cadence of the sessions.
+ * If the next frame of every session is expected well beyond the cost of
+ * a resume, collapse right away; if one is imminent keep the core powered
+ * for the default delay.
+ */
+static u32 __predict_pc_delay(struct venus_hfi_device *device)
+{
+	u64 curr_time_ns, next_ns;
+	u32 etb_pending = 0;
+
+	device->pc_predicted_idle_ns = 0;
+	device->pc_held = false;
+
+	if (!msm_vidc_pc_prediction)
+		return device->res->msm_vidc_pwr_collapse_delay;
+
+	curr_time_ns = ktime_get_ns();
+	next_ns = __next_expected_etb_ns(device, curr_time_ns, &etb_pending);
+	if (next_ns == U64_MAX || etb_pending)
+		return device->res->msm_vidc_pwr_collapse_delay;
+
+	if (next_ns <= curr_time_ns ||
+		next_ns - curr_time_ns < __pc_breakeven_ns(device)) {
+		device->pc_held = true;
+		return device->res->msm_vidc_pwr_collapse_delay;
+	}
+
+	device->pc_predicted_idle_ns = next_ns - curr_time_ns;
+	d_vpr_l("%s: next frame in %llu us, collapse early\n", __func__,
+		div_u64(device->pc_predicted_idle_ns, NSEC_PER_USEC));
+
+	return VIDC_PC_EARLY_DELAY_MS;
+}
+
+/*
+ * Arms a resume just ahead of the next expected input so that the power
+ * up cost is paid from the pm workqueue rather than in the client's qbuf.
+ */
+static void __schedule_spec_resume(struct venus_hfi_device *device)
+{
+	u64 curr_time_ns, next_ns, lead_ns;
+	u32 etb_pending = 0;
+
+	if (!msm_vidc_pc_spec_resume)
+		return;
+
+	curr_time_ns = ktime_get_ns();
+	next_ns = __next_expected_etb_ns(device, curr_time_ns, &etb_pending);
+	if (next_ns == U64_MAX)
+		return;
+
+	lead_ns = ((u64)device->pm_stats.resume_avg_us +
+		VIDC_PC_RESUME_LEAD_US) * NSEC_PER_USEC;
+	if (next_ns <= curr_time_ns + lead_ns)
+		return;
+
+	d_vpr_l("%s: resume in %llu us\n", __func__,
+		div_u64(next_ns - curr_time_ns - lead_ns, NSEC_PER_USEC));
+	queue_delayed_work(device->venus_pm_workq, &venus_hfi_resume_work,
+		nsecs_to_jiffies(next_ns - curr_time_ns - lead_ns));
+}
+
+static void __update_resume_stats(struct venus_hfi_device *device,
+		u64 start_ns)
+{
+	static const u32 hist_limits_us[HAL_PM_RESUME_HIST_BUCKETS - 1] = {
+		1000, 2000, 5000, 10000, 20000,
+	};
+	struct hal_pm_stats *stats = &device->pm_stats;
+	u32 latency_us;
+	int i;
+
+	/* a speculative resume is not a client wakeup, so not a mispredict */
+	if (device->pc_early && !device->pc_spec_resuming &&
+		start_ns - device->pc_time_ns < __pc_breakeven_ns(device))
+		stats->mispredict_early++;
+	device->pc_early = false;
+
+	latency_us = (u32)div_u64(ktime_get_ns() - start_ns, NSEC_PER_USEC);
+	for (i = 0; i < ARRAY_SIZE(hist_limits_us); i++) {
+		if (latency_us < hist_limits_us[i])
+			break;
+	}
+	stats->resume_hist[i]++;
+	stats->resumes++;
+	stats->resume_max_us = max(stats->resume_max_us, latency_us);
+	stats->resume_avg_us = stats->resume_avg_us ?
+		(stats->resume_avg_us * 7 + latency_us) >> 3 : latency_us;
+}
+
+static void __update_session_cadence(struct hal_session *session)
+{
+	u64 curr_time_ns = ktime_get_ns();
+	u64 interval_ns = curr_time_ns - session->last_etb_ns;
+
+	if (!session->last_etb_ns ||
+		interval_ns > VIDC_PC_MAX_ETB_INTERVAL_NS)
+		session->etb_interval_ns = 0;
+	else if (!session->etb_interval_ns)
+		session->etb_interval_ns = interval_ns;
+	else
+		session->etb_interval_ns =
+			(session->etb_interval_ns * 3 + interval_ns) >> 2;
+
+	session->last_etb_ns = curr_time_ns;
+}
+
 /* Writes into cmdq without raising an interrupt */
 static int __iface_cmdq_write_relaxed(struct venus_hfi_device *device,
 		void *pkt, bool *requires_interrupt, u32 sid)
@@ -1249,21 +1460,25 @@ static int __iface_cmdq_write_relaxed(struct venus_hfi_device *device,
 	}
 
 	__sim_modify_cmd_packet((u8 *)pkt, device);
+	if (device->pc_spec_resumed &&
+		cmd_packet->packet_type != HFI_CMD_SYS_PC_PREP) {
+		device->pm_stats.spec_hits++;
+		device->pc_spec_resumed = false;
+	}
 	if (__resume(device, sid)) {
 		s_vpr_e(sid, "%s: Power on failed\n", __func__);
 		goto err_q_write;
 	}
 
 	if (!__write_queue(q_info, (u8 *)pkt, requires_interrupt, sid)) {
-		if (device->res->sw_power_collapsible) {
-			cancel_delayed_work(&venus_hfi_pm_work);
-			if (!queue_delayed_work(device->venus_pm_workq,
-				&venus_hfi_pm_work,
-				msecs_to_jiffies(
-				device->res->msm_vidc_pwr_collapse_delay))) {
-				s_vpr_l(sid, "PM work already scheduled\n");
-			}
-		}
+		/*
+		 * A response is expected for this command, the delay gets
+		 * re-predicted once it arrives.
+		 */
+		device->pc_predicted_idle_ns = 0;
+		device->pc_held = false;
+		__schedule_power_collapse(device,
+			device->res->msm_vidc_pwr_collapse_delay, sid);
 
 		result = 0;
 	} else {
@@ -1287,43 +1502,135 @@ static int __iface_cmdq_write(struct venus_hfi_device *device,
 	return rc;
 }
 
-static int __iface_msgq_read(struct venus_hfi_device *device, void *pkt)
+/*
+ * Message queue packets are parsed in place: __iface_msgq_next() returns a
+ * pointer into the shared queue unless the packet wraps around the end of
+ * the queue (or needs fixing up for the simulator), in which case it is
+ * copied into @bounce. Packets stay valid until __iface_msgq_end()
+ * publishes the read index, which is done once per batch.
+ */
+static void __iface_msgq_begin(struct venus_hfi_device *device,
+		struct vidc_iface_q_cursor *cursor)
 {
-	u32 tx_req_is_set = 0;
-	int rc = 0;
 	struct vidc_iface_q_info *q_info;
+	int rc;
 
-	if (!pkt) {
-		d_vpr_e("%s: invalid params\n", __func__);
-		return -EINVAL;
+	memset(cursor, 0, sizeof(*cursor));
+	/*
+	 * The caller checked the core state under device->lock; the queues
+	 * are released under resp_lock, so they are still there if mapped.
+	 */
+	lockdep_assert_held(&device->resp_lock);
+
+	q_info = &device->iface_queues[VIDC_IFACEQ_MSGQ_IDX];
+	if (!q_info->q_array.align_virtual_addr || !q_info->q_hdr) {
+		d_vpr_e("cannot read from shared MSG Q's\n");
+		return;
 	}
 
-	__strict_check(device);
+	__iface_q_ring(q_info, &cursor->ring);
+	rc = hfi_ring_peek(&cursor->ring, &cursor->read_idx,
+		&cursor->write_idx);
+	if (rc == -EINVAL) {
+		d_vpr_e("Invalid read index\n");
+		return;
+	}
 
-	if (!__core_in_valid_state(device)) {
-		d_vpr_e("%s: fw not in init state\n", __func__);
-		rc = -EINVAL;
-		goto read_error_null;
+	cursor->qinfo = q_info;
+	cursor->copy = device->hal_data->firmware_base &&
+		!is_iommu_present(device->res);
+}
+
+static int __iface_msgq_next(struct venus_hfi_device *device,
+		struct vidc_iface_q_cursor *cursor, u8 *bounce, u8 **packet)
+{
+	struct hfi_ring *ring = &cursor->ring;
+	u32 packet_size_in_words;
+	u32 *read_ptr;
+	u32 sid;
+
+	if (!cursor->qinfo || !bounce || !packet)
+		return -ENODATA;
+
+	if (cursor->read_idx == cursor->write_idx) {
+		/* pick up packets queued by venus since the batch started */
+		cursor->write_idx = hfi_ring_refresh(ring);
+		if (cursor->read_idx == cursor->write_idx)
+			return -ENODATA;
 	}
 
-	q_info = &device->iface_queues[VIDC_IFACEQ_MSGQ_IDX];
-	if (!q_info->q_array.align_virtual_addr) {
-		d_vpr_e("cannot read from shared MSG Q's\n");
-		rc = -ENODATA;
-		goto read_error_null;
+	read_ptr = hfi_ring_ptr(ring, cursor->read_idx);
+	packet_size_in_words = (*read_ptr) >> 2;
+	if (!packet_size_in_words ||
+		(packet_size_in_words << 2) > VIDC_IFACEQ_VAR_HUGE_PKT_SIZE) {
+		d_vpr_e("BAD packet received, read_idx: %#x, pkt_size: %d\n",
+			cursor->read_idx, packet_size_in_words << 2);
+		d_vpr_e("Dropping this packet\n");
+		cursor->read_idx = cursor->write_idx;
+		return -ENODATA;
 	}
 
-	if (!__read_queue(q_info, (u8 *)pkt, &tx_req_is_set)) {
-		__hal_sim_modify_msg_packet((u8 *)pkt, device);
-		if (tx_req_is_set)
-			call_venus_op(device, raise_interrupt, device,
-				DEFAULT_SID);
-		rc = 0;
-	} else
-		rc = -ENODATA;
+	if (!cursor->copy &&
+		!hfi_ring_wraps(ring, cursor->read_idx, packet_size_in_words)) {
+		*packet = (u8 *)read_ptr;
+		cursor->read_idx = hfi_ring_advance(ring, cursor->read_idx,
+			packet_size_in_words);
+	} else {
+		cursor->read_idx = hfi_ring_read(ring, cursor->read_idx,
+			bounce, packet_size_in_words);
+		*packet = bounce;
+		device->pm_stats.msgq_copies++;
+		__hal_sim_modify_msg_packet(bounce, device);
+	}
+	cursor->count++;
 
-read_error_null:
-	return rc;
+	if (msm_vidc_debug & VIDC_PKT) {
+		sid = *((u32 *)*packet + 2);
+		s_vpr_t(sid, "%s: %pK\n", __func__, cursor->qinfo);
+		__dump_packet(*packet, sid);
+	}
+
+	return 0;
+}
+
+static void __iface_msgq_end(struct venus_hfi_device *device,
+		struct vidc_iface_q_cursor *cursor)
+{
+	struct hfi_queue_header *queue;
+
+	if (!cursor->qinfo)
+		return;
+
+	queue = (struct hfi_queue_header *)cursor->qinfo->q_hdr;
+
+	/*
+	 * Ask for an interrupt only once the queue has been drained, and
+	 * not at all while the response worker is polling.
+	 */
+	queue->qhdr_rx_req = !cursor->poll &&
+		cursor->read_idx == queue->qhdr_write_idx;
+	hfi_ring_consume(&cursor->ring, cursor->read_idx);
+	/*
+	 * mb() to ensure rx_req and the read index are updated in main
+	 * memory before the write index and tx_req are sampled below
+	 */
+	mb();
+
+	/*
+	 * Neither packets left behind by a deferred read nor one queued
+	 * before venus saw rx_req will raise an interrupt.
+	 */
+	device->msgq_pending = !cursor->poll &&
+		READ_ONCE(queue->qhdr_write_idx) != cursor->read_idx;
+
+	if (cursor->count) {
+		device->pm_stats.msgq_batches++;
+		device->pm_stats.msgq_packets += cursor->count;
+	}
+
+	/* venus is waiting for space in the queue */
+	if (cursor->count && queue->qhdr_tx_req == 1)
+		atomic_set(&device->doorbell_pending, 1);
 }
 
 static int __iface_dbgq_read(struct venus_hfi_device *device, void *pkt)
@@ -1337,7 +1644,7 @@ static int __iface_dbgq_read(struct venus_hfi_device *device, void *pkt)
 		return -EINVAL;
 	}
 
-	__strict_check(device);
+	lockdep_assert_held(&device->resp_lock);
 
 	q_info = &device->iface_queues[VIDC_IFACEQ_DBGQ_IDX];
 	if (!q_info->q_array.align_virtual_addr) {
@@ -1348,8 +1655,7 @@ static int __iface_dbgq_read(struct venus_hfi_device *device, void *pkt)
 
 	if (!__read_queue(q_info, (u8 *)pkt, &tx_req_is_set)) {
 		if (tx_req_is_set)
-			call_venus_op(device, raise_interrupt, device,
-				DEFAULT_SID);
+			atomic_set(&device->doorbell_pending, 1);
 		rc = 0;
 	} else
 		rc = -ENODATA;
@@ -1712,9 +2018,11 @@ static int venus_hfi_core_init(void *device)
 
 	d_vpr_h("Core initializing\n");
 
-	mutex_lock(&dev->lock);
+	__lock_device(dev);
 
 	dev->bus_vote = DEFAULT_BUS_VOTE;
+	dev->last_bus_vote = DEFAULT_BUS_VOTE;
+	dev->restored_bus_vote = DEFAULT_BUS_VOTE;
 
 	rc = __load_fw(dev);
 	if (rc) {
@@ -1789,7 +2097,7 @@ static int venus_hfi_core_release(void *dev)
 		return -ENODEV;
 	}
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	d_vpr_h("Core releasing\n");
 
 	__resume(device, DEFAULT_SID);
@@ -1798,8 +2106,10 @@ static int venus_hfi_core_release(void *dev)
 	__unload_fw(device);
 
 	/* unlink all sessions from device */
-	list_for_each_entry_safe(session, next, &device->sess_head, list)
+	list_for_each_entry_safe(session, next, &device->sess_head, list) {
+		RCU_INIT_POINTER(device->sessions[session->sid - 1], NULL);
 		list_del(&session->list);
+	}
 
 	d_vpr_h("Core released successfully\n");
 	mutex_unlock(&device->lock);
@@ -1819,7 +2129,7 @@ static int venus_hfi_core_ping(void *device, u32 sid)
 	}
 
 	dev = device;
-	mutex_lock(&dev->lock);
+	__lock_device(dev);
 
 	rc = call_hfi_pkt_op(dev, sys_ping, &pkt, sid);
 	if (rc) {
@@ -1849,7 +2159,7 @@ static int venus_hfi_core_trigger_ssr(void *device,
 	}
 
 	dev = device;
-	mutex_lock(&dev->lock);
+	__lock_device(dev);
 
 	rc = call_hfi_pkt_op(dev, ssr_cmd, &pkt, ssr_type,
 			sub_client_id, test_addr);
@@ -1876,7 +2186,7 @@ static int venus_hfi_session_set_property(void *sess,
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	int rc = 0;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 
 	if (!__is_session_valid(device, session, __func__)) {
 		rc = -EINVAL;
@@ -1933,13 +2243,18 @@ static void __session_clean(struct hal_session *session)
 	 */
 	list_for_each_entry_safe(temp, next, &device->sess_head, list) {
 		if (session == temp) {
+			RCU_INIT_POINTER(device->sessions[session->sid - 1],
+				NULL);
 			list_del(&session->list);
 			break;
 		}
 	}
-	/* Poison the session handle with zeros */
-	*session = (struct hal_session){ {0} };
-	kfree(session);
+	/*
+	 * Not poisoned: a response handler that looked the session up under
+	 * rcu_read_lock() may still read its sid and inst_id until the grace
+	 * period ends.
+	 */
+	kfree_rcu(session, rcu);
 }
 
 static int venus_hfi_session_clean(void *sess)
@@ -1947,7 +2262,7 @@ static int venus_hfi_session_clean(void *sess)
 	struct hal_session *session = sess;
 	struct venus_hfi_device *device = &venus_hfi_dev;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	__session_clean(session);
 	mutex_unlock(&device->lock);
 	return 0;
@@ -1967,7 +2282,7 @@ static int venus_hfi_session_init(void *device, void *inst_id,
 	}
 
 	dev = device;
-	mutex_lock(&dev->lock);
+	__lock_device(dev);
 
 	s = kzalloc(sizeof(struct hal_session), GFP_KERNEL);
 	if (!s) {
@@ -1983,7 +2298,15 @@ static int venus_hfi_session_init(void *device, void *inst_id,
 	s_vpr_hp(sid, "%s: inst %pK, session %pK, codec 0x%x, domain 0x%x\n",
 		__func__, inst_id, s, s->codec, s->domain);
 
+	if (!sid || sid > VIDC_MAX_SESSION_ID ||
+		rcu_access_pointer(dev->sessions[sid - 1])) {
+		s_vpr_e(sid, "new session fail: session id in use\n");
+		kfree(s);
+		s = NULL;
+		goto err_session_init_fail;
+	}
 	list_add_tail(&s->list, &dev->sess_head);
+	rcu_assign_pointer(dev->sessions[sid - 1], s);
 
 	__set_default_sys_properties(device, sid);
 
@@ -2040,7 +2363,7 @@ static int venus_hfi_session_end(void *sess)
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	int rc = 0;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	if (!__is_session_valid(device, session, __func__)) {
 		rc = -EINVAL;
 		goto exit;
@@ -2063,7 +2386,7 @@ static int venus_hfi_session_abort(void *sess)
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	int rc = 0;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 
 	__flush_debug_queue(device, NULL);
 	rc = __send_session_cmd(session, HFI_CMD_SYS_SESSION_ABORT);
@@ -2087,7 +2410,7 @@ static int venus_hfi_session_set_buffers(void *sess,
 		return -EINVAL;
 	}
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 
 	if (!__is_session_valid(device, session, __func__)) {
 		rc = -EINVAL;
@@ -2129,12 +2452,13 @@ static int venus_hfi_session_release_buffers(void *sess,
 	struct hal_session *session = sess;
 	struct venus_hfi_device *device = &venus_hfi_dev;
 
-	if (!buffer_info) {
+	if (!buffer_info || !buffer_info->num_buffers ||
+		buffer_info->num_buffers > HAL_MAX_RELEASE_BUFFERS) {
 		d_vpr_e("%s: invalid params\n", __func__);
 		return -EINVAL;
 	}
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 
 	if (!__is_session_valid(device, session, __func__)) {
 		rc = -EINVAL;
@@ -2155,8 +2479,8 @@ static int venus_hfi_session_release_buffers(void *sess,
 		goto err_create_pkt;
 	}
 
-	s_vpr_h(session->sid, "Release buffers: %#x\n",
-		buffer_info->buffer_type);
+	s_vpr_h(session->sid, "Release buffers: %#x count %u\n",
+		buffer_info->buffer_type, buffer_info->num_buffers);
 	if (__iface_cmdq_write(device, pkt, session->sid))
 		rc = -ENOTEMPTY;
 
@@ -2171,7 +2495,7 @@ static int venus_hfi_session_load_res(void *sess)
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	int rc = 0;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __send_session_cmd(session, HFI_CMD_SESSION_LOAD_RESOURCES);
 	mutex_unlock(&device->lock);
 
@@ -2184,7 +2508,7 @@ static int venus_hfi_session_release_res(void *sess)
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	int rc = 0;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __send_session_cmd(session, HFI_CMD_SESSION_RELEASE_RESOURCES);
 	mutex_unlock(&device->lock);
 
@@ -2197,7 +2521,7 @@ static int venus_hfi_session_start(void *sess)
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	int rc = 0;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __send_session_cmd(session, HFI_CMD_SESSION_START);
 	mutex_unlock(&device->lock);
 
@@ -2210,7 +2534,7 @@ static int venus_hfi_session_continue(void *sess)
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	int rc = 0;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __send_session_cmd(session, HFI_CMD_SESSION_CONTINUE);
 	mutex_unlock(&device->lock);
 
@@ -2223,7 +2547,7 @@ static int venus_hfi_session_stop(void *sess)
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	int rc = 0;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __send_session_cmd(session, HFI_CMD_SESSION_STOP);
 	mutex_unlock(&device->lock);
 
@@ -2278,6 +2602,11 @@ static int __session_etb(struct hal_session *session,
 			goto err_create_pkt;
 	}
 
+	atomic_inc(&session->etb_pending);
+	/* a batch of etbs counts as a single frame for the cadence */
+	if (!relaxed)
+		__update_session_cadence(session);
+
 err_create_pkt:
 	return rc;
 }
@@ -2294,7 +2623,7 @@ static int venus_hfi_session_etb(void *sess,
 		return -EINVAL;
 	}
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __session_etb(session, input_frame, false);
 	mutex_unlock(&device->lock);
 	return rc;
@@ -2339,7 +2668,7 @@ static int venus_hfi_session_ftb(void *sess,
 		return -EINVAL;
 	}
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	rc = __session_ftb(session, output_frame, false);
 	mutex_unlock(&device->lock);
 	return rc;
@@ -2354,7 +2683,7 @@ static int venus_hfi_session_process_batch(void *sess,
 	struct venus_hfi_device *device = &venus_hfi_dev;
 	bool is_last_frame = false;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 
 	if (!__is_session_valid(device, session, __func__)) {
 		rc = -EINVAL;
@@ -2393,7 +2722,7 @@ static int venus_hfi_session_get_buf_req(void *sess)
 	struct hal_session *session = sess;
 	struct venus_hfi_device *device = &venus_hfi_dev;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 
 	if (!__is_session_valid(device, session, __func__)) {
 		rc = -ENODEV;
@@ -2420,7 +2749,7 @@ static int venus_hfi_session_flush(void *sess, enum hal_flush flush_mode)
 	struct hal_session *session = sess;
 	struct venus_hfi_device *device = &venus_hfi_dev;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	if (!__is_session_valid(device, session, __func__)) {
 		rc = -ENODEV;
 		goto err_create_pkt;
@@ -2516,6 +2845,8 @@ err_pc_prep:
 static void venus_hfi_pm_handler(struct work_struct *work)
 {
 	int rc = 0;
+	u64 predicted_idle_ns;
+	bool powered, held;
 	struct venus_hfi_device *device = list_first_entry(
 			&hal_ctxt.dev_head, struct venus_hfi_device, list);
 
@@ -2537,8 +2868,20 @@ static void venus_hfi_pm_handler(struct work_struct *work)
 		return;
 	}
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
+	/* sys_pc_prep re-arms the pm work, so sample the prediction first */
+	predicted_idle_ns = device->pc_predicted_idle_ns;
+	held = device->pc_held;
+	powered = device->power_enabled;
 	rc = __power_collapse(device, false);
+	if (!rc && powered) {
+		device->pc_early = !!predicted_idle_ns;
+		if (predicted_idle_ns)
+			device->pm_stats.early_collapses++;
+		else if (held)
+			device->pm_stats.mispredict_held++;
+		__schedule_spec_resume(device);
+	}
 	mutex_unlock(&device->lock);
 	switch (rc) {
 	case 0:
@@ -2555,6 +2898,14 @@ static void venus_hfi_pm_handler(struct work_struct *work)
 			device->res->msm_vidc_pwr_collapse_delay));
 		break;
 	case -EAGAIN:
+		if (predicted_idle_ns) {
+			/* early attempt raced with firmware, not a failure */
+			d_vpr_h("%s: early PC skipped, core busy\n", __func__);
+			queue_delayed_work(device->venus_pm_workq,
+				&venus_hfi_pm_work, msecs_to_jiffies(
+				device->res->msm_vidc_pwr_collapse_delay));
+			break;
+		}
 		device->skip_pc_count++;
 		d_vpr_e("%s: retry power collapse (count %d)\n",
 			__func__, device->skip_pc_count);
@@ -2568,6 +2919,40 @@ static void venus_hfi_pm_handler(struct work_struct *work)
 	}
 }
 
+static void venus_hfi_resume_handler(struct work_struct *work)
+{
+	struct venus_hfi_device *device = list_first_entry(
+			&hal_ctxt.dev_head, struct venus_hfi_device, list);
+	int rc;
+
+	if (!device) {
+		d_vpr_e("%s: NULL device\n", __func__);
+		return;
+	}
+
+	__lock_device(device);
+	if (!msm_vidc_pc_spec_resume || device->power_enabled ||
+		!__core_in_valid_state(device))
+		goto exit;
+
+	d_vpr_l("%s: resuming ahead of next frame\n", __func__);
+	device->pc_spec_resuming = true;
+	rc = __resume(device, DEFAULT_SID);
+	device->pc_spec_resuming = false;
+	if (rc) {
+		d_vpr_e("%s: speculative resume failed\n", __func__);
+		goto exit;
+	}
+	device->pm_stats.spec_resumes++;
+	device->pc_spec_resumed = true;
+
+	/* collapse again if the expected frame never shows up */
+	__schedule_power_collapse(device,
+		device->res->msm_vidc_pwr_collapse_delay, DEFAULT_SID);
+exit:
+	mutex_unlock(&device->lock);
+}
+
 static int __power_collapse(struct venus_hfi_device *device, bool force)
 {
 	int rc = 0;
@@ -2593,8 +2978,16 @@ static int __power_collapse(struct venus_hfi_device *device, bool force)
 	__flush_debug_queue(device, device->raw_packet);
 
 	rc = __suspend(device);
-	if (rc)
+	if (rc) {
 		d_vpr_e("Failed __suspend\n");
+	} else {
+		device->pm_stats.collapses++;
+		device->pc_time_ns = ktime_get_ns();
+		device->pc_early = false;
+		if (device->pc_spec_resumed)
+			device->pm_stats.spec_wasted++;
+		device->pc_spec_resumed = false;
+	}
 
 exit:
 	return rc;
@@ -2626,7 +3019,9 @@ static void print_sfr_message(struct venus_hfi_device *device)
 	}
 }
 
-static void __flush_debug_queue(struct venus_hfi_device *device, u8 *packet)
+/* caller holds resp_lock */
+static void __flush_debug_queue_locked(struct venus_hfi_device *device,
+		u8 *packet)
 {
 	bool local_packet = false;
 	enum vidc_msg_prio log_level = msm_vidc_debug;
@@ -2696,16 +3091,38 @@ static void __flush_debug_queue(struct venus_hfi_device *device, u8 *packet)
 		kfree(packet);
 }
 
+/* caller holds device->lock */
+static void __flush_debug_queue(struct venus_hfi_device *device, u8 *packet)
+{
+	if (!device) {
+		d_vpr_e("%s: invalid params\n", __func__);
+		return;
+	}
+
+	lockdep_assert_held(&device->lock);
+	__lock_resp(device);
+	__flush_debug_queue_locked(device, packet);
+	mutex_unlock(&device->resp_lock);
+	__ring_deferred_doorbell(device);
+}
+
+/*
+ * device->sessions[] maps a session id to its hal_session. It is only
+ * updated under device->lock; readers either hold device->lock or are
+ * inside an RCU read side section, sessions are freed after a grace
+ * period.
+ */
 static bool __is_session_valid(struct venus_hfi_device *device,
 		struct hal_session *session, const char *func)
 {
-	struct hal_session *temp = NULL;
+	int i;
 
 	if (!device || !session)
 		goto invalid;
 
-	list_for_each_entry(temp, &device->sess_head, list)
-		if (session == temp)
+	/* compare handles only, a stale session must not be dereferenced */
+	for (i = 0; i < VIDC_MAX_SESSION_ID; i++)
+		if (rcu_access_pointer(device->sessions[i]) == session)
 			return true;
 
 invalid:
@@ -2716,14 +3133,11 @@ invalid:
 static struct hal_session *__get_session(struct venus_hfi_device *device,
 		u32 sid)
 {
-	struct hal_session *temp = NULL;
-
-	list_for_each_entry(temp, &device->sess_head, list) {
-		if (sid == temp->sid)
-			return temp;
-	}
+	if (!sid || sid > VIDC_MAX_SESSION_ID)
+		return NULL;
 
-	return NULL;
+	return rcu_dereference_check(device->sessions[sid - 1],
+			lockdep_is_held(&device->lock));
 }
 
 static bool __watchdog_common(u32 intr_status)
@@ -2736,27 +3150,46 @@ static bool __watchdog_common(u32 intr_status)
 	return rc;
 }
 
-static int __response_handler(struct venus_hfi_device *device)
+static inline bool __cb_record_is_data(struct vidc_cb_record *r)
 {
-	struct msm_vidc_cb_info *packets;
-	int packet_count = 0;
-	u8 *raw_packet = NULL;
-	bool requeue_pm_work = true;
+	return r->response_type == HAL_SESSION_ETB_DONE ||
+		r->response_type == HAL_SESSION_FTB_DONE;
+}
+
+static inline void *__cb_record_response(struct vidc_cb_record *r)
+{
+	return __cb_record_is_data(r) ? (void *)&r->data :
+		(void *)&r->info->response;
+}
+
+static int __response_handler(struct venus_hfi_device *device,
+		u32 intr_status, bool poll)
+{
+	struct vidc_cb_record *packets;
+	struct msm_vidc_cb_info *infos;
+	struct vidc_iface_q_cursor cursor;
+	int packet_count = 0, info_count = 0;
+	u8 *raw_packet = NULL, *packet = NULL;
 
-	if (!device || device->state != VENUS_STATE_INIT)
+	/* core state is checked by the caller under device->lock */
+	if (!device)
 		return 0;
 
 	packets = device->response_pkt;
+	infos = device->response_info;
 
 	raw_packet = device->raw_packet;
 
-	if (!raw_packet || !packets) {
-		d_vpr_e("%s: Invalid args %pK, %pK\n",
-			__func__, raw_packet, packets);
+	if (!raw_packet || !packets || !infos) {
+		d_vpr_e("%s: Invalid args %pK, %pK, %pK\n",
+			__func__, raw_packet, packets, infos);
 		return 0;
 	}
 
-	if (call_venus_op(device, watchdog, device->intr_status)) {
+	lockdep_assert_held(&device->resp_lock);
+	device->msgq_pending = false;
+
+	if (call_venus_op(device, watchdog, intr_status)) {
 		struct msm_vidc_cb_info info = {
 			.response_type = HAL_SYS_WATCHDOG_TIMEOUT,
 			.response.cmd = {
@@ -2767,26 +3200,36 @@ static int __response_handler(struct venus_hfi_device *device)
 		print_sfr_message(device);
 
 		d_vpr_e("Received watchdog timeout\n");
-		packets[packet_count++] = info;
+		infos[0] = info;
+		packets[packet_count++] = (struct vidc_cb_record) {
+			.response_type = info.response_type,
+			.info = &infos[0],
+		};
 		goto exit;
 	}
 
 	/* Bleed the msg queue dry of packets */
-	while (!__iface_msgq_read(device, raw_packet)) {
+	__iface_msgq_begin(device, &cursor);
+	cursor.poll = poll;
+	while (!__iface_msgq_next(device, &cursor, raw_packet, &packet)) {
 		void **inst_id = NULL;
-		struct msm_vidc_cb_info *info = &packets[packet_count++];
+		struct msm_vidc_cb_info *info = &infos[info_count];
+		struct vidc_cb_record *record;
 		int rc = 0;
 
+		info->sid = 0;
 		rc = hfi_process_msg_packet(device->device_id,
-			(struct vidc_hal_msg_pkt_hdr *)raw_packet, info);
+			(struct vidc_hal_msg_pkt_hdr *)packet, info);
 		if (rc) {
 			d_vpr_e("Corrupt/unknown packet found, discarding\n");
-			--packet_count;
 			continue;
 		}
 
 		/* Process the packet types that we're interested in */
 		switch (info->response_type) {
+		case HAL_SESSION_FTB_DONE:
+			device->pm_stats.frames++;
+			break;
 		case HAL_SYS_ERROR:
 			print_sfr_message(device);
 			break;
@@ -2848,20 +3291,42 @@ static int __response_handler(struct venus_hfi_device *device)
 				d_vpr_e("Upper 32-bits != 0 for sess_id=%pK\n",
 					*inst_id);
 			}
+			rcu_read_lock();
 			session = __get_session(device,
 					(u32)(uintptr_t)*inst_id);
 			if (!session) {
+				rcu_read_unlock();
 				d_vpr_e(
 					"Received a packet (%#x) for an unrecognized session (%pK), discarding\n",
 					info->response_type, *inst_id);
-				--packet_count;
 				continue;
 			}
 
+			info->sid = session->sid;
 			*inst_id = session->inst_id;
+
+			/* etb_pending is also updated under device->lock */
+			if (info->response_type == HAL_SESSION_ETB_DONE)
+				atomic_dec_if_positive(&session->etb_pending);
+			else if (info->response_type == HAL_SESSION_FLUSH_DONE &&
+				(info->response.cmd.data.flush_type &
+				HAL_FLUSH_INPUT))
+				atomic_set(&session->etb_pending, 0);
+			rcu_read_unlock();
 		}
 
-		if (packet_count >= max_packets) {
+		record = &packets[packet_count++];
+		record->response_type = info->response_type;
+		record->sid = info->sid;
+		if (__cb_record_is_data(record)) {
+			record->data = info->response.data;
+		} else {
+			record->info = info;
+			info_count++;
+		}
+
+		if (packet_count >= max_packets ||
+			info_count >= max_info_packets) {
 			d_vpr_e(
 				"Too many packets in message queue to handle at once, deferring read\n");
 			break;
@@ -2871,31 +3336,202 @@ static int __response_handler(struct venus_hfi_device *device)
 		if (info->response_type == HAL_SYS_ERROR)
 			break;
 	}
+	__iface_msgq_end(device, &cursor);
 
-	if (requeue_pm_work && device->res->sw_power_collapsible) {
-		cancel_delayed_work(&venus_hfi_pm_work);
-		if (!queue_delayed_work(device->venus_pm_workq,
-			&venus_hfi_pm_work,
-			msecs_to_jiffies(
-				device->res->msm_vidc_pwr_collapse_delay))) {
-			d_vpr_e("PM work already scheduled\n");
+exit:
+	__flush_debug_queue_locked(device, raw_packet);
+
+	return packet_count;
+}
+
+static void __cb_queue_work(struct work_struct *work)
+{
+	struct vidc_cb_queue *q =
+		container_of(work, struct vidc_cb_queue, work);
+	struct venus_hfi_device *device = q->device;
+	struct vidc_cb_record *r;
+
+	for (;;) {
+		spin_lock(&q->lock);
+		r = q->count ? &q->ring[q->head] : NULL;
+		spin_unlock(&q->lock);
+		if (!r)
+			break;
+
+		if (__core_in_valid_state(device))
+			device->callback(r->response_type, &r->data);
+		else
+			s_vpr_e(r->sid,
+				"Ignore response %#x as device is in invalid state\n",
+				r->response_type);
+
+		/* the slot is only reused once it has been consumed */
+		spin_lock(&q->lock);
+		q->head = (q->head + 1) % q->size;
+		q->count--;
+		spin_unlock(&q->lock);
+	}
+}
+
+static int __cb_queues_init(struct venus_hfi_device *device)
+{
+	struct vidc_cb_queue *q;
+	int i;
+
+	for (i = 0; i < VIDC_CB_QUEUES; i++) {
+		q = &device->cb_queues[i];
+		q->ring = kvcalloc(max_packets, sizeof(*q->ring), GFP_KERNEL);
+		if (!q->ring)
+			return -ENOMEM;
+		q->size = max_packets;
+		q->head = 0;
+		q->count = 0;
+		q->device = device;
+		spin_lock_init(&q->lock);
+		INIT_WORK(&q->work, __cb_queue_work);
+	}
+
+	return 0;
+}
+
+static void __cb_queues_deinit(struct venus_hfi_device *device)
+{
+	int i;
+
+	for (i = 0; i < VIDC_CB_QUEUES; i++) {
+		kvfree(device->cb_queues[i].ring);
+		device->cb_queues[i].ring = NULL;
+	}
+}
+
+static void __cb_queues_flush(struct venus_hfi_device *device)
+{
+	int i;
+
+	for (i = 0; i < VIDC_CB_QUEUES; i++)
+		flush_work(&device->cb_queues[i].work);
+}
+
+/*
+ * Hands an ETB/FBD done to its session's queue, false if not queued.
+ * Other session responses are rare and point into device->response_info,
+ * which the next drain round reuses, so they are delivered inline.
+ */
+static bool __cb_queue_add(struct venus_hfi_device *device,
+		struct vidc_cb_record *r)
+{
+	struct vidc_cb_queue *q;
+	bool queued;
+
+	if (!device->cb_workq || !r->sid)
+		return false;
+
+	q = &device->cb_queues[r->sid % VIDC_CB_QUEUES];
+	spin_lock(&q->lock);
+	queued = msm_vidc_cb_demux && __cb_record_is_data(r) &&
+		q->count < q->size;
+	if (queued) {
+		q->ring[(q->head + q->count) % q->size] = *r;
+		q->count++;
+	}
+	spin_unlock(&q->lock);
+
+	if (!queued) {
+		/*
+		 * Delivered inline, either because demux was turned off, it
+		 * is not a data done or the ring is full. Drain the shard
+		 * first so that this response does not overtake ones queued
+		 * or in flight.
+		 */
+		flush_work(&q->work);
+		return false;
+	}
+	queue_work(device->cb_workq, &q->work);
+
+	return true;
+}
+
+static bool __dispatch_responses(struct venus_hfi_device *device,
+		int num_responses)
+{
+	int i;
+
+	for (i = 0; !IS_ERR_OR_NULL(device->response_pkt) &&
+		i < num_responses; ++i) {
+		struct vidc_cb_record *r = &device->response_pkt[i];
+
+		if (!__core_in_valid_state(device)) {
+			d_vpr_e(
+				"Ignore responses from %d to %d as device is in invalid state",
+				(i + 1), num_responses);
+			return false;
 		}
+		if (__cb_queue_add(device, r))
+			continue;
+
+		/*
+		 * System responses are delivered inline, after everything
+		 * queued before them.
+		 */
+		if (!r->sid)
+			__cb_queues_flush(device);
+		device->callback(r->response_type, __cb_record_response(r));
 	}
 
-exit:
-	__flush_debug_queue(device, raw_packet);
+	return true;
+}
 
-	return packet_count;
+/*
+ * Under load, keep the irq masked and poll the message queue for up to
+ * msm_vidc_msgq_poll_us with rx_req cleared, so bursts of EBD/FBD are
+ * picked up without an interrupt and a work item each. Polling ends
+ * with one more drain in interrupt mode which re-arms rx_req.
+ *
+ * A work item polls at most once, and re-drains for packets that raced
+ * with re-arming rx_req at most VIDC_MSGQ_MAX_PENDING_ROUNDS times, so
+ * the irq is re-enabled and intr_status re-read under steady load too.
+ */
+static bool __msgq_keep_polling(struct venus_hfi_device *device,
+		int num_responses, struct vidc_msgq_poll *poll)
+{
+	u64 now_ns = ktime_get_ns();
+
+	if (!poll->polling) {
+		if (device->msgq_pending)
+			return poll->pending_rounds++ <
+				VIDC_MSGQ_MAX_PENDING_ROUNDS;
+		if (poll->polled || !msm_vidc_msgq_poll_us ||
+			num_responses < msm_vidc_msgq_poll_min)
+			return false;
+		poll->polling = true;
+		poll->polled = true;
+		poll->end_ns = now_ns +
+			(u64)msm_vidc_msgq_poll_us * NSEC_PER_USEC;
+	} else {
+		device->pm_stats.poll_rounds++;
+		device->pm_stats.poll_packets += num_responses;
+		/* idle round, back to interrupt mode */
+		if (!num_responses || now_ns >= poll->end_ns) {
+			poll->polling = false;
+			return true;
+		}
+	}
+
+	usleep_range(VIDC_MSGQ_POLL_INTERVAL_US,
+		VIDC_MSGQ_POLL_INTERVAL_US * 2);
+	return true;
 }
 
 static void venus_hfi_core_work_handler(struct work_struct *work)
 {
 	struct venus_hfi_device *device = list_first_entry(
 		&hal_ctxt.dev_head, struct venus_hfi_device, list);
-	int num_responses = 0, i = 0;
+	int num_responses = 0;
 	u32 intr_status;
+	bool drain = false, resched = false;
+	struct vidc_msgq_poll poll = {0};
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	if (!__core_in_valid_state(device)) {
 		d_vpr_e("%s: Core not in init state\n", __func__);
 		goto err_no_work;
@@ -2913,7 +3549,12 @@ static void venus_hfi_core_work_handler(struct work_struct *work)
 	}
 
 	call_venus_op(device, core_clear_interrupt, device);
-	num_responses = __response_handler(device);
+	drain = true;
+
+	/* idle prediction walks sess_head, keep it under device->lock */
+	if (!call_venus_op(device, watchdog, device->intr_status))
+		__schedule_power_collapse(device,
+			__predict_pc_delay(device), DEFAULT_SID);
 
 err_no_work:
 
@@ -2922,26 +3563,47 @@ err_no_work:
 	mutex_unlock(&device->lock);
 
 	/*
-	 * Issue the callbacks outside of the locked contex to preserve
-	 * re-entrancy.
+	 * The queues are in memory, reading them does not need the core
+	 * powered, so don't hold up command submission while draining.
+	 * Register access (doorbells) and the core state check go back
+	 * under device->lock between rounds.
 	 */
+	while (drain) {
+		__lock_resp(device);
+		num_responses = __response_handler(device, intr_status,
+			poll.polling);
+		mutex_unlock(&device->resp_lock);
 
-	for (i = 0; !IS_ERR_OR_NULL(device->response_pkt) &&
-		i < num_responses; ++i) {
-		struct msm_vidc_cb_info *r = &device->response_pkt[i];
-
-		if (!__core_in_valid_state(device)) {
-			d_vpr_e(
-				"Ignore responses from %d to %d as device is in invalid state",
-				(i + 1), num_responses);
+		/*
+		 * Issue the callbacks outside of the locked contex to preserve
+		 * re-entrancy.
+		 */
+		if (!__dispatch_responses(device, num_responses))
 			break;
-		}
-		device->callback(r->response_type, &r->response);
+
+		drain = !call_venus_op(device, watchdog, intr_status) &&
+			__msgq_keep_polling(device, num_responses, &poll);
+		resched = !drain && device->msgq_pending;
+
+		__lock_device(device);
+		__ring_deferred_doorbell(device);
+		if (!__core_in_valid_state(device))
+			drain = resched = false;
+		mutex_unlock(&device->lock);
 	}
 
 	/* We need re-enable the irq which was disabled in ISR handler */
-	if (!call_venus_op(device, watchdog, intr_status))
+	if (!call_venus_op(device, watchdog, intr_status)) {
 		enable_irq(device->hal_data->irq);
+		/*
+		 * Out of re-drain rounds with a packet venus may not raise
+		 * an interrupt for, go round again as if it had.
+		 */
+		if (resched) {
+			disable_irq_nosync(device->hal_data->irq);
+			queue_work(device->vidc_workq, &venus_hfi_work);
+		}
+	}
 
 	/*
 	 * XXX: Don't add any code beyond here.  Reacquiring locks after release
@@ -2956,6 +3618,7 @@ static irqreturn_t venus_hfi_isr(int irq, void *dev)
 	struct venus_hfi_device *device = dev;
 
 	disable_irq_nosync(irq);
+	device->pm_stats.interrupts++;
 	queue_work(device->vidc_workq, &venus_hfi_work);
 	return IRQ_HANDLED;
 }
@@ -3127,6 +3790,8 @@ void __disable_unprepare_clks(struct venus_hfi_device *device)
 		return;
 	}
 
+	__lock_res(device);
+	device->clks_enabled = false;
 	venus_hfi_for_each_clock_reverse(device, cl) {
 		d_vpr_h("Clock: %s disable and unprepare\n",
 				cl->name);
@@ -3141,6 +3806,7 @@ void __disable_unprepare_clks(struct venus_hfi_device *device)
 			d_vpr_e("%s: clock %s not disabled\n",
 				__func__, cl->name);
 	}
+	mutex_unlock(&device->res_lock);
 }
 
 int __reset_ahb2axi_bridge_common(struct venus_hfi_device *device, u32 sid)
@@ -3187,6 +3853,7 @@ static inline int __prepare_enable_clks(struct venus_hfi_device *device,
 		return -EINVAL;
 	}
 
+	__lock_res(device);
 	venus_hfi_for_each_clock(device, cl) {
 		/*
 		 * For the clocks we control, set the rate prior to preparing
@@ -3217,6 +3884,8 @@ static inline int __prepare_enable_clks(struct venus_hfi_device *device,
 	}
 
 	call_venus_op(device, clock_config_on_enable, device, sid);
+	device->clks_enabled = true;
+	mutex_unlock(&device->res_lock);
 	return rc;
 
 fail_clk_enable:
@@ -3225,6 +3894,7 @@ fail_clk_enable:
 			cl->name);
 		clk_disable_unprepare(cl->clk);
 	}
+	mutex_unlock(&device->res_lock);
 
 	return rc;
 }
@@ -3783,16 +4453,45 @@ fail_to_set_ubwc_config:
 	return rc;
 }
 
+/*
+ * Bandwidth to vote on power up: the last aggregated session vote plus
+ * some headroom when restoring is enabled, else the maximum.
+ */
+static void __get_power_on_bus_vote(struct venus_hfi_device *device,
+		unsigned long *bw_ddr, unsigned long *bw_llcc)
+{
+	struct msm_vidc_bus_data *last = &device->last_bus_vote;
+
+	*bw_ddr = *bw_llcc = INT_MAX;
+	device->restored_bus_vote = DEFAULT_BUS_VOTE;
+
+	if (!msm_vidc_bus_restore_vote || !last->total_bw_ddr ||
+		last->total_bw_ddr >= INT_MAX)
+		return;
+
+	*bw_ddr = last->total_bw_ddr +
+		last->total_bw_ddr * VIDC_BUS_RESTORE_MARGIN_PCT / 100;
+	*bw_llcc = last->total_bw_llcc +
+		last->total_bw_llcc * VIDC_BUS_RESTORE_MARGIN_PCT / 100;
+	device->restored_bus_vote.total_bw_ddr = *bw_ddr;
+	device->restored_bus_vote.total_bw_llcc = *bw_llcc;
+	device->pm_stats.bus_restores++;
+}
+
 static int __venus_power_on(struct venus_hfi_device *device, u32 sid)
 {
 	int rc = 0;
+	unsigned long bw_ddr, bw_llcc;
 
 	if (device->power_enabled)
 		return 0;
 
 	device->power_enabled = true;
 	/* Vote for all hardware resources */
-	rc = __vote_buses(device, INT_MAX, INT_MAX, sid);
+	__lock_res(device);
+	__get_power_on_bus_vote(device, &bw_ddr, &bw_llcc);
+	rc = __vote_buses(device, bw_ddr, bw_llcc, sid);
+	mutex_unlock(&device->res_lock);
 	if (rc) {
 		s_vpr_e(sid, "Failed to vote buses, err: %d\n", rc);
 		goto fail_vote_buses;
@@ -3816,7 +4515,9 @@ static int __venus_power_on(struct venus_hfi_device *device, u32 sid)
 		goto fail_enable_clks;
 	}
 
+	__lock_res(device);
 	rc = __scale_clocks(device, sid);
+	mutex_unlock(&device->res_lock);
 	if (rc) {
 		s_vpr_e(sid,
 			"Failed to scale clocks, performance might be affected\n");
@@ -3877,6 +4578,7 @@ err_tzbsp_suspend:
 static inline int __resume(struct venus_hfi_device *device, u32 sid)
 {
 	int rc = 0;
+	u64 start_ns;
 
 	if (!device) {
 		s_vpr_e(sid, "%s: invalid params\n", __func__);
@@ -3888,6 +4590,11 @@ static inline int __resume(struct venus_hfi_device *device, u32 sid)
 		return -EINVAL;
 	}
 
+	/* client got here before the speculative resume */
+	if (cancel_delayed_work(&venus_hfi_resume_work))
+		device->pm_stats.spec_late++;
+
+	start_ns = ktime_get_ns();
 	s_vpr_h(sid, "Resuming from power collapse\n");
 	rc = __venus_power_on(device, sid);
 	if (rc) {
@@ -3926,6 +4633,7 @@ static inline int __resume(struct venus_hfi_device *device, u32 sid)
 	__enable_subcaches(device, sid);
 	__set_subcaches(device, sid);
 
+	__update_resume_stats(device, start_ns);
 	s_vpr_h(sid, "Resumed from power collapse\n");
 exit:
 	/* Don't reset skip_pc_count for SYS_PC_PREP cmd */
@@ -4019,11 +4727,14 @@ static void __unload_fw(struct venus_hfi_device *device)
 		return;
 
 	cancel_delayed_work(&venus_hfi_pm_work);
+	cancel_delayed_work(&venus_hfi_resume_work);
 	if (device->state != VENUS_STATE_DEINIT)
 		flush_workqueue(device->venus_pm_workq);
 
 	subsystem_put(device->resources.fw.cookie);
+	__lock_resp(device);
 	__interface_queues_release(device);
+	mutex_unlock(&device->resp_lock);
 	call_venus_op(device, power_off, device);
 	device->resources.fw.cookie = NULL;
 	__deinit_resources(device);
@@ -4046,7 +4757,7 @@ static int venus_hfi_get_fw_info(void *dev, struct hal_fw_info *fw_info)
 		return -EINVAL;
 	}
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 
 	smem_table_ptr = qcom_smem_get(QCOM_SMEM_HOST_ANY,
 			SMEM_IMAGE_VERSION_TABLE, &smem_block_size);
@@ -4082,6 +4793,23 @@ fail_version_string:
 	return 0;
 }
 
+static int venus_hfi_get_pm_stats(void *dev, struct hal_pm_stats *stats)
+{
+	struct venus_hfi_device *device = dev;
+
+	if (!device || !stats) {
+		d_vpr_e("%s: invalid params %pK %pK\n",
+			__func__, device, stats);
+		return -EINVAL;
+	}
+
+	__lock_device(device);
+	*stats = device->pm_stats;
+	mutex_unlock(&device->lock);
+
+	return 0;
+}
+
 static int venus_hfi_get_core_capabilities(void *dev)
 {
 	struct venus_hfi_device *device = dev;
@@ -4090,7 +4818,7 @@ static int venus_hfi_get_core_capabilities(void *dev)
 	if (!device)
 		return -EINVAL;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 
 	rc = HAL_VIDEO_ENCODER_ROTATION_CAPABILITY |
 		HAL_VIDEO_ENCODER_SCALING_CAPABILITY |
@@ -4161,7 +4889,7 @@ static int venus_hfi_noc_error_info(void *dev)
 	}
 	device = dev;
 
-	mutex_lock(&device->lock);
+	__lock_device(device);
 	d_vpr_e("%s: non error information\n", __func__);
 
 	call_venus_op(device, noc_error_info, device);
@@ -4221,6 +4949,13 @@ static struct venus_hfi_device *__add_device(u32 device_id,
 		goto err_cleanup;
 	}
 
+	hdevice->response_info = kmalloc_array(max_info_packets,
+				sizeof(*hdevice->response_info), GFP_KERNEL);
+	if (!hdevice->response_info) {
+		d_vpr_e("failed to allocate response_info\n");
+		goto err_cleanup;
+	}
+
 	hdevice->raw_packet =
 		kzalloc(VIDC_IFACEQ_VAR_HUGE_PKT_SIZE, GFP_KERNEL);
 	if (!hdevice->raw_packet) {
@@ -4252,10 +4987,23 @@ static struct venus_hfi_device *__add_device(u32 device_id,
 		goto err_cleanup;
 	}
 
+	if (__cb_queues_init(hdevice)) {
+		d_vpr_e("%s: allocate callback queues failed\n", __func__);
+		goto err_cleanup;
+	}
+	hdevice->cb_workq = alloc_workqueue("msm_vidc_cb_venus",
+			WQ_UNBOUND | WQ_HIGHPRI, VIDC_CB_QUEUES);
+	if (!hdevice->cb_workq) {
+		d_vpr_e("%s: create callback workq failed\n", __func__);
+		goto err_cleanup;
+	}
+
 	if (!hal_ctxt.dev_count)
 		INIT_LIST_HEAD(&hal_ctxt.dev_head);
 
 	mutex_init(&hdevice->lock);
+	mutex_init(&hdevice->resp_lock);
+	mutex_init(&hdevice->res_lock);
 	INIT_LIST_HEAD(&hdevice->list);
 	INIT_LIST_HEAD(&hdevice->sess_head);
 	list_add_tail(&hdevice->list, &hal_ctxt.dev_head);
@@ -4266,7 +5014,11 @@ static struct venus_hfi_device *__add_device(u32 device_id,
 err_cleanup:
 	if (hdevice->vidc_workq)
 		destroy_workqueue(hdevice->vidc_workq);
+	if (hdevice->venus_pm_workq)
+		destroy_workqueue(hdevice->venus_pm_workq);
+	__cb_queues_deinit(hdevice);
 	kfree(hdevice->response_pkt);
+	kfree(hdevice->response_info);
 	kfree(hdevice->raw_packet);
 	return NULL;
 }
@@ -4297,13 +5049,18 @@ void venus_hfi_delete_device(void *device)
 		if (close->hal_data->irq == dev->hal_data->irq) {
 			hal_ctxt.dev_count--;
 			list_del(&close->list);
+			mutex_destroy(&close->res_lock);
+			mutex_destroy(&close->resp_lock);
 			mutex_destroy(&close->lock);
 			destroy_workqueue(close->vidc_workq);
+			destroy_workqueue(close->cb_workq);
+			__cb_queues_deinit(close);
 			destroy_workqueue(close->venus_pm_workq);
 			free_irq(dev->hal_data->irq, close);
 			iounmap(dev->hal_data->register_base);
 			kfree(close->hal_data);
 			kfree(close->response_pkt);
+			kfree(close->response_info);
 			kfree(close->raw_packet);
 			break;
 		}
@@ -4338,6 +5095,7 @@ static void venus_init_hfi_callbacks(struct hfi_device *hdev)
 	hdev->scale_clocks = venus_hfi_scale_clocks;
 	hdev->vote_bus = venus_hfi_vote_buses;
 	hdev->get_fw_info = venus_hfi_get_fw_info;
+	hdev->get_pm_stats = venus_hfi_get_pm_stats;
 	hdev->get_core_capabilities = venus_hfi_get_core_capabilities;
 	hdev->suspend = venus_hfi_suspend;
 	hdev->flush_debug_queue = venus_hfi_flush_debug_queue;
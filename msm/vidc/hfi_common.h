@@ -22,6 +22,7 @@
 #include "msm_vidc_bus.h"
 #include "hfi_packetization.h"
 #include "hfi_io_common.h"
+#include "hfi_ring.h"
 
 #define HFI_MASK_QHDR_TX_TYPE			0xFF000000
 #define HFI_MASK_QHDR_RX_TYPE			0x00FF0000
@@ -44,6 +45,17 @@
 
 #define VIDC_MAX_NAME_LENGTH 64
 #define VIDC_MAX_PC_SKIP_COUNT 10
+/* Delay used when the predictor expects the core to stay idle */
+#define VIDC_PC_EARLY_DELAY_MS 2
+/* Idle gap (vs. resume cost) below which collapsing doesn't pay off */
+#define VIDC_PC_BREAKEVEN_FACTOR 4
+#define VIDC_PC_MIN_BREAKEVEN_US 16000
+/* Inter-frame gaps beyond this restart the cadence estimate */
+#define VIDC_PC_MAX_ETB_INTERVAL_NS (10ULL * NSEC_PER_SEC)
+/* Slack added on top of the average resume time for speculative resume */
+#define VIDC_PC_RESUME_LEAD_US 2000
+/* Headroom on the bandwidth restored on power up */
+#define VIDC_BUS_RESTORE_MARGIN_PCT 25
 #define VIDC_MAX_SUBCACHES 4
 #define VIDC_MAX_SUBCACHE_SIZE 52
 
@@ -134,6 +146,61 @@ struct vidc_iface_q_info {
 	struct vidc_mem_addr q_array;
 };
 
+#define VIDC_CB_QUEUES 4
+
+/*
+ * A response parsed out of the message queue. ETB/FBD done, the bulk of
+ * the traffic, is kept as a compact data record; any other response is
+ * parsed into device->response_info and referenced from here.
+ */
+struct vidc_cb_record {
+	enum hal_command_response response_type;
+	u32 sid;
+	union {
+		struct msm_vidc_cb_data_done data;
+		struct msm_vidc_cb_info *info;
+	};
+};
+
+/*
+ * ETB/FBD done responses are handed to one of VIDC_CB_QUEUES queues by
+ * sid, so callbacks keep their order within a session but a slow callback
+ * only holds up the sessions sharing its queue. Each queue is a ring of
+ * max_packets records, allocated with the device, so one drain round fits
+ * even if all of it lands on one queue.
+ */
+struct vidc_cb_queue {
+	struct venus_hfi_device *device;
+	struct work_struct work;
+	spinlock_t lock;
+	struct vidc_cb_record *ring;
+	u32 size;
+	u32 head;
+	u32 count;
+};
+
+/*
+ * Private read position in the message queue for one response batch;
+ * the queue header read index is only updated when the batch ends.
+ */
+struct vidc_iface_q_cursor {
+	struct vidc_iface_q_info *qinfo;
+	struct hfi_ring ring;
+	u32 read_idx;
+	u32 write_idx;
+	u32 count;
+	bool copy;
+	bool poll;
+};
+
+/* message queue polling state of one response work item */
+struct vidc_msgq_poll {
+	bool polling;
+	bool polled;
+	u32 pending_rounds;
+	u64 end_ns;
+};
+
 /*
  * These are helper macros to iterate over various lists within
  * venus_hfi_device->res.  The intention is to cut down on a lot of boiler-plate
@@ -250,13 +317,28 @@ struct venus_hfi_vpu_ops {
 struct venus_hfi_device {
 	struct list_head list;
 	struct list_head sess_head;
+	struct hal_session __rcu *sessions[VIDC_MAX_SESSION_ID];
 	u32 intr_status;
 	u32 device_id;
 	u32 clk_freq;
+	u32 clk_freq_pending;
+	bool clks_enabled;
 	u32 last_packet_type;
 	struct msm_vidc_bus_data bus_vote;
+	struct msm_vidc_bus_data last_bus_vote;
+	struct msm_vidc_bus_data restored_bus_vote;
 	bool power_enabled;
+	/*
+	 * lock: power state, firmware state and command queue writes, which
+	 * need the core powered. resp_lock: message and debug queue reads.
+	 * res_lock: clock and bus votes. Lock order is lock -> resp_lock and
+	 * lock -> res_lock; resp_lock and res_lock are never nested.
+	 */
 	struct mutex lock;
+	struct mutex resp_lock;
+	struct mutex res_lock;
+	bool msgq_pending;
+	atomic_t doorbell_pending;
 	msm_vidc_callback callback;
 	struct vidc_mem_addr iface_q_table;
 	struct vidc_mem_addr dsp_iface_q_table;
@@ -268,6 +350,8 @@ struct venus_hfi_device {
 	u32 dsp_flags;
 	struct hal_data *hal_data;
 	struct workqueue_struct *vidc_workq;
+	struct workqueue_struct *cb_workq;
+	struct vidc_cb_queue cb_queues[VIDC_CB_QUEUES];
 	struct workqueue_struct *venus_pm_workq;
 	int spur_count;
 	int reg_count;
@@ -276,10 +360,18 @@ struct venus_hfi_device {
 	enum venus_hfi_state state;
 	struct hfi_packetization_ops *pkt_ops;
 	enum hfi_packetization_type packetization_type;
-	struct msm_vidc_cb_info *response_pkt;
+	struct vidc_cb_record *response_pkt;
+	struct msm_vidc_cb_info *response_info;
 	u8 *raw_packet;
 	unsigned int skip_pc_count;
 	struct venus_hfi_vpu_ops *vpu_ops;
+	struct hal_pm_stats pm_stats;
+	u64 pc_time_ns;
+	u64 pc_predicted_idle_ns;
+	bool pc_held;
+	bool pc_early;
+	bool pc_spec_resumed;
+	bool pc_spec_resuming;
 };
 
 void venus_hfi_delete_device(void *device);
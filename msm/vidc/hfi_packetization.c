@@ -442,9 +442,10 @@ int create_pkt_cmd_session_release_buffers(
 
 		buff = (struct hfi_buffer_info *) pkt->rg_buffer_info;
 		for (i = 0; i < pkt->num_buffers; i++) {
-			buff->buffer_addr =
+			buff[i].buffer_addr = buffer_info->device_addrs ?
+				buffer_info->device_addrs[i] :
 				(u32)buffer_info->align_device_addr;
-			buff->extra_data_addr =
+			buff[i].extra_data_addr =
 				(u32)buffer_info->extradata_addr;
 		}
 		pkt->size = sizeof(struct hfi_cmd_session_set_buffers_packet) -
@@ -452,7 +453,8 @@ int create_pkt_cmd_session_release_buffers(
 				sizeof(struct hfi_buffer_info));
 	} else {
 		for (i = 0; i < pkt->num_buffers; i++) {
-			pkt->rg_buffer_info[i] =
+			pkt->rg_buffer_info[i] = buffer_info->device_addrs ?
+				buffer_info->device_addrs[i] :
 				(u32)buffer_info->align_device_addr;
 		}
 		pkt->extra_data_size = 0;
@@ -66,6 +66,9 @@ static enum vidc_status hfi_map_err_status(u32 hfi_err)
 	case HFI_ERR_SESSION_START_CODE_NOT_FOUND:
 		vidc_err = VIDC_ERR_START_CODE_NOT_FOUND;
 		break;
+	case HFI_ERR_SESSION_ENC_OVERFLOW:
+		vidc_err = VIDC_ERR_INSUFFICIENT_BUFFER;
+		break;
 	case HFI_ERR_SESSION_EMPTY_BUFFER_DONE_OUTPUT_PENDING:
 	default:
 		vidc_err = VIDC_ERR_FAIL;
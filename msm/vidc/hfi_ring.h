@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+#ifndef __HFI_RING_H__
+#define __HFI_RING_H__
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/compiler.h>
+#include <asm/barrier.h>
+
+/*
+ * Single producer / single consumer ring of 32-bit words shared with
+ * the firmware. Indices are in words and live in the queue header; the
+ * producer only ever writes the write index and the consumer only ever
+ * writes the read index, so neither side needs a lock against the other.
+ * One word is always left free so a full ring can be told from an empty
+ * one.
+ *
+ * Producer: hfi_ring_reserve() -> hfi_ring_write() -> hfi_ring_commit()
+ * Consumer: hfi_ring_peek() -> hfi_ring_read()/hfi_ring_ptr()
+ *	     -> hfi_ring_consume()
+ *
+ * The other side is a device, so ordering uses the dma_* barriers:
+ * commit releases the packet with dma_wmb() before publishing the write
+ * index and peek acquires it with dma_rmb() after loading the index.
+ * consume publishes the read index with a release store, which orders
+ * the reads of the consumed packets before it. Doorbell handshakes
+ * (rx_req/tx_req) stay with the caller and need their own barrier.
+ */
+struct hfi_ring {
+	u32 *base;
+	u32 size;
+	u32 *read_idx;
+	u32 *write_idx;
+};
+
+struct hfi_ring_span {
+	u32 start;
+	u32 words;
+};
+
+static inline void hfi_ring_init(struct hfi_ring *ring, void *base,
+		u32 size_bytes, u32 *read_idx, u32 *write_idx)
+{
+	ring->base = base;
+	ring->size = size_bytes >> 2;
+	ring->read_idx = read_idx;
+	ring->write_idx = write_idx;
+}
+
+static inline u32 hfi_ring_used(const struct hfi_ring *ring,
+		u32 read, u32 write)
+{
+	return write >= read ? write - read : ring->size - (read - write);
+}
+
+static inline u32 *hfi_ring_ptr(const struct hfi_ring *ring, u32 idx)
+{
+	return ring->base + idx;
+}
+
+static inline u32 hfi_ring_advance(const struct hfi_ring *ring,
+		u32 idx, u32 words)
+{
+	idx += words;
+	return idx >= ring->size ? idx - ring->size : idx;
+}
+
+/* true if @words starting at @idx run past the end of the ring */
+static inline bool hfi_ring_wraps(const struct hfi_ring *ring,
+		u32 idx, u32 words)
+{
+	return idx + words > ring->size;
+}
+
+static inline int hfi_ring_reserve(struct hfi_ring *ring, u32 words,
+		struct hfi_ring_span *span)
+{
+	u32 read = READ_ONCE(*ring->read_idx);
+	u32 write = READ_ONCE(*ring->write_idx);
+
+	if (read >= ring->size || write >= ring->size)
+		return -EINVAL;
+
+	if (ring->size - hfi_ring_used(ring, read, write) <= words)
+		return -ENOSPC;
+
+	span->start = write;
+	span->words = words;
+	return 0;
+}
+
+static inline void hfi_ring_write(struct hfi_ring *ring,
+		const struct hfi_ring_span *span, const void *data)
+{
+	u32 first = min(span->words, ring->size - span->start);
+
+	memcpy(hfi_ring_ptr(ring, span->start), data, first << 2);
+	if (first < span->words)
+		memcpy(ring->base, (const u8 *)data + (first << 2),
+			(span->words - first) << 2);
+}
+
+static inline void hfi_ring_commit(struct hfi_ring *ring,
+		const struct hfi_ring_span *span)
+{
+	/* packet must be visible before the new write index */
+	dma_wmb();
+	WRITE_ONCE(*ring->write_idx,
+		hfi_ring_advance(ring, span->start, span->words));
+}
+
+/*
+ * Loads the current read and write index, returns -ENODATA if the ring
+ * is empty. Data up to @write may be read once this returns 0.
+ */
+static inline int hfi_ring_peek(struct hfi_ring *ring, u32 *read,
+		u32 *write)
+{
+	*read = READ_ONCE(*ring->read_idx);
+	*write = READ_ONCE(*ring->write_idx);
+	dma_rmb();
+
+	if (*read >= ring->size || *write >= ring->size)
+		return -EINVAL;
+
+	return *read == *write ? -ENODATA : 0;
+}
+
+/* reloads the write index for a consumer already holding @read */
+static inline u32 hfi_ring_refresh(struct hfi_ring *ring)
+{
+	u32 write = READ_ONCE(*ring->write_idx);
+
+	dma_rmb();
+	return write;
+}
+
+/* copies @words out of the ring at @read, returns the next read index */
+static inline u32 hfi_ring_read(const struct hfi_ring *ring, u32 read,
+		void *data, u32 words)
+{
+	u32 first = min(words, ring->size - read);
+
+	memcpy(data, hfi_ring_ptr(ring, read), first << 2);
+	if (first < words)
+		memcpy((u8 *)data + (first << 2), ring->base,
+			(words - first) << 2);
+
+	return hfi_ring_advance(ring, read, words);
+}
+
+static inline void hfi_ring_consume(struct hfi_ring *ring, u32 read)
+{
+	/* all reads of the consumed packets must complete first */
+	smp_store_release(ring->read_idx, read);
+}
+
+#endif
@@ -181,7 +181,13 @@ void msm_smem_put_dma_buf(void *dma_buf, u32 sid)
 	dma_buf_put((struct dma_buf *)dma_buf);
 }
 
-int msm_smem_map_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
+/*
+ * Maps @smem onto @dbuf, which the caller has already resolved from
+ * smem->fd. Takes over the caller's reference to @dbuf, it is dropped if
+ * @smem is already mapped or the map fails.
+ */
+int msm_smem_map_dma_buf_ref(struct msm_vidc_inst *inst,
+	struct msm_smem *smem, struct dma_buf *dbuf)
 {
 	int rc = 0;
 
@@ -189,25 +195,19 @@ int msm_smem_map_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
 	u32 temp = 0;
 	unsigned long buffer_size = 0;
 	unsigned long align = SZ_4K;
-	struct dma_buf *dbuf;
 	unsigned long ion_flags = 0;
 	u32 b_type = HAL_BUFFER_INPUT | HAL_BUFFER_OUTPUT | HAL_BUFFER_OUTPUT2;
 
-	if (!inst || !smem) {
-		d_vpr_e("%s: invalid params: %pK %pK\n",
-				__func__, inst, smem);
+	if (!inst || !smem || !dbuf) {
+		d_vpr_e("%s: invalid params: %pK %pK %pK\n",
+				__func__, inst, smem, dbuf);
 		rc = -EINVAL;
 		goto exit;
 	}
 
 	if (smem->refcount) {
 		smem->refcount++;
-		goto exit;
-	}
-
-	dbuf = msm_smem_get_dma_buf(smem->fd, inst->sid);
-	if (!dbuf) {
-		rc = -EINVAL;
+		msm_smem_put_dma_buf(dbuf, inst->sid);
 		goto exit;
 	}
 
@@ -259,10 +259,98 @@ fail_iova_truncation:
 			smem->buffer_type, inst->sid);
 fail_map_dma_buf:
 	msm_smem_put_dma_buf(dbuf, inst->sid);
+	smem->dma_buf = NULL;
 exit:
 	return rc;
 }
 
+int msm_smem_map_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
+{
+	struct dma_buf *dbuf;
+
+	if (!inst || !smem) {
+		d_vpr_e("%s: invalid params: %pK %pK\n",
+				__func__, inst, smem);
+		return -EINVAL;
+	}
+
+	if (smem->refcount) {
+		smem->refcount++;
+		return 0;
+	}
+
+	dbuf = msm_smem_get_dma_buf(smem->fd, inst->sid);
+	if (!dbuf)
+		return -EINVAL;
+
+	return msm_smem_map_dma_buf_ref(inst, smem, dbuf);
+}
+
+static void msm_smem_release_prepared(struct kref *kref)
+{
+	struct msm_vidc_prepared_buf *pbuf = container_of(kref,
+			struct msm_vidc_prepared_buf, kref);
+
+	s_vpr_h(pbuf->inst->sid,
+		"unprepared: type %d index %d plane %d daddr %#x\n",
+		pbuf->type, pbuf->index, pbuf->plane, pbuf->smem.device_addr);
+	msm_smem_unmap_dma_buf(pbuf->inst, &pbuf->smem);
+	kfree(pbuf);
+}
+
+/*
+ * Drops a reference on a prepared buffer. The iova is unmapped along
+ * with the last reference, which is either the prepared list or a
+ * queued buffer still borrowing the mapping.
+ */
+void msm_smem_put_prepared(struct msm_vidc_prepared_buf *pbuf)
+{
+	if (pbuf)
+		kref_put(&pbuf->kref, msm_smem_release_prepared);
+}
+
+/*
+ * Maps @smem onto a buffer pre-registered with VIDIOC_MSM_VIDC_PREPARE_BUF.
+ * Takes over the caller's reference to the prepared dma_buf and holds a
+ * reference on @pbuf, so its attachment and iova stay valid until @smem
+ * is unmapped. Called with the prepared list lock held.
+ */
+int msm_smem_map_prepared(struct msm_vidc_inst *inst, struct msm_smem *smem,
+	struct msm_vidc_prepared_buf *pbuf)
+{
+	struct dma_buf *dbuf;
+
+	if (!inst || !smem || !pbuf || !pbuf->smem.dma_buf) {
+		d_vpr_e("%s: invalid params: %pK %pK %pK\n",
+			__func__, inst, smem, pbuf);
+		return -EINVAL;
+	}
+
+	dbuf = pbuf->smem.dma_buf;
+	if (smem->refcount) {
+		smem->refcount++;
+		msm_smem_put_dma_buf(dbuf, inst->sid);
+		return 0;
+	}
+
+	if (dbuf->size < smem->size) {
+		s_vpr_e(inst->sid,
+			"Size mismatch: Dmabuf size: %zu Expected Size: %u",
+			dbuf->size, smem->size);
+		msm_smem_put_dma_buf(dbuf, inst->sid);
+		return -EINVAL;
+	}
+
+	kref_get(&pbuf->kref);
+	smem->prepared = pbuf;
+	smem->dma_buf = dbuf;
+	smem->flags |= pbuf->smem.flags | SMEM_PREPARED;
+	smem->device_addr = pbuf->smem.device_addr + smem->offset;
+	smem->refcount++;
+
+	return 0;
+}
+
 int msm_smem_unmap_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
 {
 	int rc = 0;
@@ -285,6 +373,14 @@ int msm_smem_unmap_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
 	if (smem->refcount)
 		goto exit;
 
+	/* the iova belongs to the prepared buffer */
+	if (smem->flags & SMEM_PREPARED) {
+		smem->flags &= ~SMEM_PREPARED;
+		msm_smem_put_prepared(smem->prepared);
+		smem->prepared = NULL;
+		goto put_dma_buf;
+	}
+
 	rc = msm_dma_put_device_address(smem->flags, &smem->mapping_info,
 		smem->buffer_type, inst->sid);
 	if (rc) {
@@ -292,6 +388,8 @@ int msm_smem_unmap_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
 		goto exit;
 	}
 
+put_dma_buf:
+
 	msm_smem_put_dma_buf(smem->dma_buf, inst->sid);
 
 	smem->device_addr = 0x0;
@@ -523,6 +621,42 @@ int msm_smem_free(struct msm_smem *smem, u32 sid)
 	return rc;
 };
 
+/*
+ * Zeroes a non-secure buffer through a temporary kernel mapping; the end
+ * of the cpu access writes the zeroes back for cached buffers. Secure
+ * buffers are not accessible from the CPU.
+ */
+int msm_smem_clear(struct msm_smem *smem, u32 sid)
+{
+	struct dma_buf *dbuf;
+	void *kvaddr;
+	int rc;
+
+	if (!smem || !smem->dma_buf) {
+		s_vpr_e(sid, "%s: invalid params\n", __func__);
+		return -EINVAL;
+	}
+	if (smem->flags & SMEM_SECURE)
+		return -EPERM;
+
+	dbuf = smem->dma_buf;
+	rc = dma_buf_begin_cpu_access(dbuf, DMA_BIDIRECTIONAL);
+	if (rc)
+		return rc;
+
+	kvaddr = dma_buf_vmap(dbuf);
+	if (!kvaddr) {
+		s_vpr_e(sid, "%s: failed to map in kernel\n", __func__);
+		rc = -EIO;
+	} else {
+		memset(kvaddr, 0, smem->size);
+		dma_buf_vunmap(dbuf, kvaddr);
+	}
+	dma_buf_end_cpu_access(dbuf, DMA_BIDIRECTIONAL);
+
+	return rc;
+}
+
 int msm_smem_cache_operations(struct dma_buf *dbuf,
 	enum smem_cache_ops cache_op, unsigned long offset,
 	unsigned long size, u32 sid)
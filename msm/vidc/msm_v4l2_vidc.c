@@ -5,6 +5,7 @@
 
 #include <linux/module.h>
 #include <linux/of_platform.h>
+#include <linux/compat.h>
 #include "msm_vidc.h"
 #include "msm_vidc_common.h"
 #include "msm_vidc_debug.h"
@@ -125,6 +126,42 @@ int msm_v4l2_qbuf(struct file *file, void *fh,
 	return msm_vidc_qbuf(get_vidc_inst(file, fh), vdev->v4l2_dev->mdev, b);
 }
 
+static long msm_v4l2_prepare_buf(struct file *file, void *fh,
+				struct msm_vidc_prepare_buf *b)
+{
+	return msm_vidc_prepare_buf(get_vidc_inst(file, fh), b);
+}
+
+static long msm_v4l2_default(struct file *file, void *fh,
+				bool valid_prio, unsigned int cmd, void *arg)
+{
+	switch (cmd) {
+	case VIDIOC_MSM_VIDC_PREPARE_BUF:
+		return msm_v4l2_prepare_buf(file, fh, arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+#ifdef CONFIG_COMPAT
+/*
+ * v4l2 hands private ioctls of 32 bit clients to the driver. The vendor
+ * ioctl structs are pointer free, so they only need the user pointer
+ * converted.
+ */
+static long msm_v4l2_compat_ioctl32(struct file *file, unsigned int cmd,
+				unsigned long arg)
+{
+	switch (cmd) {
+	case VIDIOC_MSM_VIDC_PREPARE_BUF:
+		return video_ioctl2(file, cmd,
+			(unsigned long)compat_ptr(arg));
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+#endif
+
 int msm_v4l2_dqbuf(struct file *file, void *fh,
 				struct v4l2_buffer *b)
 {
@@ -227,6 +264,7 @@ const struct v4l2_ioctl_ops msm_v4l2_ioctl_ops = {
 	.vidioc_decoder_cmd = msm_v4l2_decoder_cmd,
 	.vidioc_encoder_cmd = msm_v4l2_encoder_cmd,
 	.vidioc_enum_framesizes = msm_v4l2_enum_framesizes,
+	.vidioc_default = msm_v4l2_default,
 };
 
 static const struct v4l2_ioctl_ops msm_v4l2_enc_ioctl_ops = { 0 };
@@ -244,6 +282,9 @@ static const struct v4l2_file_operations msm_v4l2_vidc_fops = {
 	.open = msm_v4l2_open,
 	.release = msm_v4l2_close,
 	.unlocked_ioctl = video_ioctl2,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl32 = msm_v4l2_compat_ioctl32,
+#endif
 	.poll = msm_v4l2_poll,
 };
 
@@ -293,6 +334,11 @@ static int msm_vidc_initialize_core(struct platform_device *pdev,
 
 	if (!core)
 		return -EINVAL;
+	rc = msm_comm_internal_pool_init(core);
+	if (rc) {
+		d_vpr_e("Failed to register internal pool shrinker\n");
+		return rc;
+	}
 	rc = read_platform_resources(core, pdev);
 	if (rc) {
 		d_vpr_e("Failed to get platform resources\n");
@@ -302,6 +348,7 @@ static int msm_vidc_initialize_core(struct platform_device *pdev,
 	INIT_LIST_HEAD(&core->instances);
 	mutex_init(&core->lock);
 	mutex_init(&core->resources.cb_lock);
+	mutex_init(&core->buf_size_cache.lock);
 
 	core->state = VIDC_CORE_UNINIT;
 	for (i = SYS_MSG_INDEX(SYS_MSG_START);
@@ -492,6 +539,16 @@ static int msm_vidc_probe_vidc_device(struct platform_device *pdev)
 
 	core->id = MSM_VIDC_CORE_VENUS;
 
+	/* session ids index the HAL session table */
+	BUILD_BUG_ON(MAX_SUPPORTED_INSTANCES_24 > VIDC_MAX_SESSION_ID);
+	if (core->platform_data->max_inst_count > VIDC_MAX_SESSION_ID) {
+		d_vpr_e("%s: max_inst_count %u exceeds %u session ids\n",
+			__func__, core->platform_data->max_inst_count,
+			VIDC_MAX_SESSION_ID);
+		rc = -EINVAL;
+		goto err_vidc_context;
+	}
+
 	vidc_driver->ctxt = kcalloc(core->platform_data->max_inst_count,
 		sizeof(*vidc_driver->ctxt), GFP_KERNEL);
 	if (!vidc_driver->ctxt)
@@ -598,6 +655,7 @@ err_v4l2_register:
 err_vidc_context:
 	sysfs_remove_group(&pdev->dev.kobj, &msm_vidc_core_attr_group);
 err_core_init:
+	msm_comm_internal_pool_deinit(core);
 	dev_set_drvdata(&pdev->dev, NULL);
 	kfree(core);
 	return rc;
@@ -653,6 +711,7 @@ static int msm_vidc_remove(struct platform_device *pdev)
 
 	if (core->vidc_core_workq)
 		destroy_workqueue(core->vidc_core_workq);
+	msm_comm_internal_pool_deinit(core);
 	vidc_hfi_deinitialize(core->hfi_type, core->device);
 	device_remove_file(&core->vdev[MSM_VIDC_ENCODER].vdev.dev,
 				&dev_attr_link_name);
@@ -666,7 +725,10 @@ static int msm_vidc_remove(struct platform_device *pdev)
 	sysfs_remove_group(&pdev->dev.kobj, &msm_vidc_core_attr_group);
 	dev_set_drvdata(&pdev->dev, NULL);
 	mutex_destroy(&core->resources.cb_lock);
+	mutex_destroy(&core->buf_size_cache.lock);
 	mutex_destroy(&core->lock);
+	kfree(core->capabilities);
+	msm_comm_ctrl_templates_free(core);
 	kfree(core);
 	kfree(vidc_driver->ctxt);
 	return rc;
@@ -678,7 +678,8 @@ int msm_vdec_s_fmt(struct msm_vidc_inst *inst, struct v4l2_format *f)
 		mplane->width = f->fmt.pix_mp.width;
 		mplane->height = f->fmt.pix_mp.height;
 		mplane->pixelformat = f->fmt.pix_mp.pixelformat;
-		rc = msm_comm_try_state(inst, MSM_VIDC_OPEN_DONE);
+		/* compute sizes while firmware handles SESSION_INIT */
+		rc = msm_comm_try_state(inst, MSM_VIDC_OPEN);
 		if (rc) {
 			s_vpr_e(inst->sid, "Failed to open instance\n");
 			goto err_invalid_fmt;
@@ -697,7 +698,13 @@ int msm_vdec_s_fmt(struct msm_vidc_inst *inst, struct v4l2_format *f)
 			s_vpr_e(inst->sid,
 				"%s failed to calculate buffer count\n",
 				__func__);
-			return rc;
+			goto err_invalid_fmt;
+		}
+
+		rc = msm_comm_try_state(inst, MSM_VIDC_OPEN_DONE);
+		if (rc) {
+			s_vpr_e(inst->sid, "Failed to open instance\n");
+			goto err_invalid_fmt;
 		}
 
 		rc = msm_vidc_check_session_supported(inst);
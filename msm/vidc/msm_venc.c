@@ -1373,18 +1373,26 @@ int msm_venc_s_fmt(struct msm_vidc_inst *inst, struct v4l2_format *f)
 			}
 		}
 
-		rc = msm_comm_try_state(inst, MSM_VIDC_OPEN_DONE);
+		/* compute sizes while firmware handles SESSION_INIT */
+		rc = msm_comm_try_state(inst, MSM_VIDC_OPEN);
 		if (rc) {
 			s_vpr_e(inst->sid, "Failed to open instance\n");
 			goto exit;
 		}
 
 		mplane->plane_fmt[0].sizeimage =
-			msm_vidc_calculate_enc_output_frame_size(inst);
+			msm_vidc_adapt_bitstream_size(inst,
+			msm_vidc_calculate_enc_output_frame_size(inst));
 		if (mplane->num_planes > 1)
 			mplane->plane_fmt[1].sizeimage =
 				msm_vidc_calculate_enc_output_extra_size(inst);
 
+		rc = msm_comm_try_state(inst, MSM_VIDC_OPEN_DONE);
+		if (rc) {
+			s_vpr_e(inst->sid, "Failed to open instance\n");
+			goto exit;
+		}
+
 		rc = msm_vidc_check_session_supported(inst);
 		if (rc) {
 			s_vpr_e(inst->sid,
@@ -1484,7 +1492,8 @@ int msm_venc_g_fmt(struct msm_vidc_inst *inst, struct v4l2_format *f)
 	if (f->type == OUTPUT_MPLANE) {
 		fmt = &inst->fmts[OUTPUT_PORT].v4l2_fmt;
 		fmt->fmt.pix_mp.plane_fmt[0].sizeimage =
-			msm_vidc_calculate_enc_output_frame_size(inst);
+			msm_vidc_adapt_bitstream_size(inst,
+			msm_vidc_calculate_enc_output_frame_size(inst));
 		if (fmt->fmt.pix_mp.num_planes > 1)
 			fmt->fmt.pix_mp.plane_fmt[1].sizeimage =
 				msm_vidc_calculate_enc_output_extra_size(inst);
@@ -289,6 +289,8 @@ int msm_vidc_reqbufs(void *instance, struct v4l2_requestbuffers *b)
 
 	mutex_lock(&q->lock);
 	rc = vb2_reqbufs(&q->vb2_bufq, b);
+	if (!rc && !b->count)
+		msm_comm_release_prepared_buffers(inst, b->type);
 	mutex_unlock(&q->lock);
 
 	if (rc)
@@ -359,6 +361,70 @@ int msm_vidc_release_buffer(void *instance, int type, unsigned int index)
 }
 EXPORT_SYMBOL(msm_vidc_release_buffer);
 
+/*
+ * Imports and maps every plane of a client buffer up front, so that the
+ * first qbuf of the buffer only has to look the mapping up. Prepared
+ * buffers stay mapped until the queue is freed with reqbufs(0), or for
+ * as long as a queued buffer still uses the mapping.
+ */
+int msm_vidc_prepare_buf(void *instance, struct msm_vidc_prepare_buf *b)
+{
+	struct msm_vidc_inst *inst = instance;
+	struct buf_queue *q = NULL;
+	enum vidc_ports port;
+	unsigned int i;
+	int rc = 0;
+
+	if (!inst || !b) {
+		d_vpr_e("%s: invalid params %pK %pK\n", __func__, inst, b);
+		return -EINVAL;
+	}
+
+	port = b->type == OUTPUT_MPLANE ? OUTPUT_PORT :
+		b->type == INPUT_MPLANE ? INPUT_PORT : MAX_PORT_NUM;
+	if (port == MAX_PORT_NUM || !b->num_planes ||
+		b->num_planes > VIDEO_MAX_PLANES ||
+		inst->fmts[port].v4l2_fmt.fmt.pix_mp.num_planes !=
+		b->num_planes) {
+		s_vpr_e(inst->sid, "%s: invalid type %u or planes %u\n",
+			__func__, b->type, b->num_planes);
+		return -EINVAL;
+	}
+
+	q = msm_comm_get_vb2q(inst, b->type);
+	if (!q) {
+		s_vpr_e(inst->sid,
+			"Failed to find buffer queue. type %d\n", b->type);
+		return -EINVAL;
+	}
+
+	mutex_lock(&q->lock);
+	if (b->memory != q->vb2_bufq.memory ||
+		b->index >= q->vb2_bufq.num_buffers) {
+		s_vpr_e(inst->sid,
+			"%s: invalid buf, type %u index %u memory %u\n",
+			__func__, b->type, b->index, b->memory);
+		rc = -EINVAL;
+		goto unlock;
+	}
+
+	for (i = 0; i < b->num_planes; i++) {
+		rc = msm_comm_prepare_buffer(inst, b->type, b->index, i,
+			b->planes[i].fd, b->planes[i].length);
+		if (rc) {
+			s_vpr_e(inst->sid,
+				"Failed to prepare buf, type %u index %u\n",
+				b->type, b->index);
+			goto unlock;
+		}
+	}
+
+unlock:
+	mutex_unlock(&q->lock);
+	return rc;
+}
+EXPORT_SYMBOL(msm_vidc_prepare_buf);
+
 int msm_vidc_qbuf(void *instance, struct media_device *mdev,
 		struct v4l2_buffer *b)
 {
@@ -388,7 +454,13 @@ int msm_vidc_qbuf(void *instance, struct media_device *mdev,
 	}
 
 	mutex_lock(&q->lock);
-	if ((inst->out_flush && b->type == OUTPUT_MPLANE) || inst->in_flush) {
+	/*
+	 * Every input flush also flushes the capture port, except the opt-in
+	 * input only decoder flush, which leaves queued capture buffers with
+	 * firmware and so keeps accepting new ones.
+	 */
+	if ((inst->out_flush && b->type == OUTPUT_MPLANE) ||
+		(inst->in_flush && b->type == INPUT_MPLANE)) {
 		s_vpr_e(inst->sid,
 			"%s: in flush, discarding qbuf, type %u, index %u\n",
 			__func__, b->type, b->index);
@@ -1534,6 +1606,7 @@ void *msm_vidc_open(int core_id, int session_type)
 	INIT_MSM_VIDC_LIST(&inst->pending_getpropq);
 	INIT_MSM_VIDC_LIST(&inst->outputbufs);
 	INIT_MSM_VIDC_LIST(&inst->registeredbufs);
+	INIT_MSM_VIDC_LIST(&inst->prepared_bufs);
 	INIT_MSM_VIDC_LIST(&inst->refbufs);
 	INIT_MSM_VIDC_LIST(&inst->eosbufs);
 	INIT_MSM_VIDC_LIST(&inst->etb_data);
@@ -1557,7 +1630,6 @@ void *msm_vidc_open(int core_id, int session_type)
 	inst->rc_type = V4L2_MPEG_VIDEO_BITRATE_MODE_VBR;
 	inst->dpb_extra_binfo = NULL;
 	inst->all_intra = false;
-	inst->max_filled_len = 0;
 	inst->entropy_mode = HFI_H264_ENTROPY_CABAC;
 	inst->full_range = COLOR_RANGE_UNSPECIFIED;
 	inst->bse_vpp_delay = DEFAULT_BSE_VPP_DELAY;
@@ -1601,7 +1673,7 @@ void *msm_vidc_open(int core_id, int session_type)
 	setup_event_queue(inst, &core->vdev[session_type].vdev);
 
 	mutex_lock(&core->lock);
-	list_add_tail(&inst->list, &core->instances);
+	list_add_tail_rcu(&inst->list, &core->instances);
 	mutex_unlock(&core->lock);
 
 	rc = msm_comm_try_state(inst, MSM_VIDC_CORE_INIT_DONE);
@@ -1627,7 +1699,7 @@ void *msm_vidc_open(int core_id, int session_type)
 	return inst;
 fail_init:
 	mutex_lock(&core->lock);
-	list_del(&inst->list);
+	list_del_rcu(&inst->list);
 	mutex_unlock(&core->lock);
 
 	v4l2_fh_del(&inst->event_handler);
@@ -1648,6 +1720,7 @@ fail_bufq_capture:
 	DEINIT_MSM_VIDC_LIST(&inst->pending_getpropq);
 	DEINIT_MSM_VIDC_LIST(&inst->outputbufs);
 	DEINIT_MSM_VIDC_LIST(&inst->registeredbufs);
+	DEINIT_MSM_VIDC_LIST(&inst->prepared_bufs);
 	DEINIT_MSM_VIDC_LIST(&inst->refbufs);
 	DEINIT_MSM_VIDC_LIST(&inst->eosbufs);
 	DEINIT_MSM_VIDC_LIST(&inst->input_crs);
@@ -1658,7 +1731,7 @@ fail_bufq_capture:
 
 err_invalid_sid:
 	put_sid(inst->sid);
-	kfree(inst);
+	kfree_rcu(inst, rcu);
 	inst = NULL;
 err_invalid_core:
 	return inst;
@@ -1705,6 +1778,8 @@ static void msm_vidc_cleanup_instance(struct msm_vidc_inst *inst)
 	}
 	mutex_unlock(&inst->registeredbufs.lock);
 
+	msm_comm_release_prepared_buffers(inst, 0);
+
 	cancel_batch_work(inst);
 
 	msm_comm_free_input_cr_table(inst);
@@ -1763,9 +1838,14 @@ int msm_vidc_destroy(struct msm_vidc_inst *inst)
 
 	mutex_lock(&core->lock);
 	/* inst->list lives in core->instances */
-	list_del(&inst->list);
+	list_del_rcu(&inst->list);
+	msm_comm_remove_mem_usage(inst);
 	mutex_unlock(&core->lock);
 
+	/* give the freed HQ budget back to the remaining sessions */
+	if (core->core_ops && core->core_ops->balance_core)
+		core->core_ops->balance_core(core);
+
 	msm_comm_ctrl_deinit(inst);
 
 	v4l2_fh_del(&inst->event_handler);
@@ -1776,6 +1856,7 @@ int msm_vidc_destroy(struct msm_vidc_inst *inst)
 	DEINIT_MSM_VIDC_LIST(&inst->pending_getpropq);
 	DEINIT_MSM_VIDC_LIST(&inst->outputbufs);
 	DEINIT_MSM_VIDC_LIST(&inst->registeredbufs);
+	DEINIT_MSM_VIDC_LIST(&inst->prepared_bufs);
 	DEINIT_MSM_VIDC_LIST(&inst->refbufs);
 	DEINIT_MSM_VIDC_LIST(&inst->eosbufs);
 	DEINIT_MSM_VIDC_LIST(&inst->input_crs);
@@ -1796,7 +1877,8 @@ int msm_vidc_destroy(struct msm_vidc_inst *inst)
 			"high", inst->sid, get_codec_name(inst->sid),
 			inst);
 	put_sid(inst->sid);
-	kfree(inst);
+	/* get_inst() may still be walking past this instance */
+	kfree_rcu(inst, rcu);
 	return 0;
 }
 
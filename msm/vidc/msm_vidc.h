@@ -24,6 +24,7 @@ enum smem_prop {
 	SMEM_CACHED = 0x2,
 	SMEM_SECURE = 0x4,
 	SMEM_ADSP = 0x8,
+	SMEM_PREPARED = 0x10,
 };
 
 /* NOTE: if you change this enum you MUST update the
@@ -62,6 +63,8 @@ struct dma_mapping_info {
 	void *cb_info;
 };
 
+struct msm_vidc_prepared_buf;
+
 struct msm_smem {
 	u32 refcount;
 	int fd;
@@ -74,6 +77,7 @@ struct msm_smem {
 	unsigned long flags;
 	enum hal_buffer buffer_type;
 	struct dma_mapping_info mapping_info;
+	struct msm_vidc_prepared_buf *prepared;
 };
 
 enum smem_cache_ops {
@@ -131,6 +135,7 @@ int msm_vidc_g_ctrl(void *instance, struct v4l2_control *a);
 int msm_vidc_reqbufs(void *instance, struct v4l2_requestbuffers *b);
 int msm_vidc_release_buffer(void *instance, int buffer_type,
 		unsigned int buffer_index);
+int msm_vidc_prepare_buf(void *instance, struct msm_vidc_prepare_buf *b);
 int msm_vidc_qbuf(void *instance, struct media_device *mdev,
 		struct v4l2_buffer *b);
 int msm_vidc_dqbuf(void *instance, struct v4l2_buffer *b);
@@ -382,21 +382,109 @@ static struct msm_vidc_enc_buff_size_calculators vp8e_calculators = {
 	.calculate_persist_size = calculate_enc_persist_size,
 };
 
+/*
+ * Internal buffer sizes only depend on the values in msm_vidc_buf_size_key,
+ * so they are memoized per core; sessions of the same geometry and codec
+ * and repeated buffer requirement queries skip the calculators.
+ */
+static bool msm_vidc_buf_size_cache_get(struct msm_vidc_buf_size_cache *cache,
+	struct msm_vidc_buf_size_key *key, struct msm_vidc_buf_size_entry *out)
+{
+	bool found = false;
+	int i;
+
+	mutex_lock(&cache->lock);
+	for (i = 0; i < MSM_VIDC_BUF_SIZE_CACHE_ENTRIES; i++) {
+		if (cache->entries[i].valid &&
+			!memcmp(&cache->entries[i].key, key, sizeof(*key))) {
+			*out = cache->entries[i];
+			found = true;
+			break;
+		}
+	}
+	if (found)
+		cache->hits++;
+	else
+		cache->misses++;
+	mutex_unlock(&cache->lock);
+
+	return found;
+}
+
+static void msm_vidc_buf_size_cache_put(struct msm_vidc_buf_size_cache *cache,
+	struct msm_vidc_buf_size_entry *entry)
+{
+	mutex_lock(&cache->lock);
+	cache->entries[cache->next] = *entry;
+	cache->entries[cache->next].valid = true;
+	cache->next = (cache->next + 1) % MSM_VIDC_BUF_SIZE_CACHE_ENTRIES;
+	mutex_unlock(&cache->lock);
+}
+
+static void msm_vidc_set_internal_buffer_sizes(struct msm_vidc_inst *inst,
+	struct msm_vidc_buf_size_entry *sizes)
+{
+	u32 i;
+
+	for (i = 0; i < HAL_BUFFER_MAX; i++) {
+		struct hal_buffer_requirements *curr_req;
+		bool valid_buffer_type = true;
+
+		curr_req = &inst->buff_req.buffer[i];
+		switch (curr_req->buffer_type) {
+		case HAL_BUFFER_INTERNAL_SCRATCH:
+			curr_req->buffer_size = sizes->scratch;
+			break;
+		case HAL_BUFFER_INTERNAL_SCRATCH_1:
+			curr_req->buffer_size = sizes->scratch1;
+			break;
+		case HAL_BUFFER_INTERNAL_SCRATCH_2:
+			if (inst->session_type != MSM_VIDC_ENCODER) {
+				valid_buffer_type = false;
+				break;
+			}
+			curr_req->buffer_size = sizes->scratch2;
+			break;
+		case HAL_BUFFER_INTERNAL_PERSIST:
+			if (inst->session_type != MSM_VIDC_ENCODER) {
+				valid_buffer_type = false;
+				break;
+			}
+			curr_req->buffer_size = sizes->persist;
+			break;
+		case HAL_BUFFER_INTERNAL_PERSIST_1:
+			if (inst->session_type != MSM_VIDC_DECODER) {
+				valid_buffer_type = false;
+				break;
+			}
+			curr_req->buffer_size = sizes->persist;
+			break;
+		default:
+			valid_buffer_type = false;
+			break;
+		}
+
+		if (valid_buffer_type) {
+			curr_req->buffer_alignment = 256;
+			curr_req->buffer_count_actual =
+				curr_req->buffer_count_min =
+				curr_req->buffer_count_min_host = 1;
+		}
+	}
+}
+
 int msm_vidc_get_decoder_internal_buffer_sizes(struct msm_vidc_inst *inst)
 {
 	struct msm_vidc_dec_buff_size_calculators *dec_calculators;
-	u32 width, height, i, out_min_count, num_vpp_pipes;
+	struct msm_vidc_buf_size_entry sizes = {0};
+	struct msm_vidc_buf_size_key *key = &sizes.key;
 	struct v4l2_format *f;
-	u32 vpp_delay;
 
 	if (!inst || !inst->core || !inst->core->platform_data) {
 		d_vpr_e("%s: Instance is null!", __func__);
 		return -EINVAL;
 	}
 
-	vpp_delay = inst->bse_vpp_delay;
-
-	num_vpp_pipes = inst->core->platform_data->num_vpp_pipes;
 	f = &inst->fmts[INPUT_PORT].v4l2_fmt;
 	switch (f->fmt.pix_mp.pixelformat) {
 	case V4L2_PIX_FMT_H264:
@@ -421,51 +509,32 @@ int msm_vidc_get_decoder_internal_buffer_sizes(struct msm_vidc_inst *inst)
 		return -EINVAL;
 	}
 
-	width = f->fmt.pix_mp.width;
-	height = f->fmt.pix_mp.height;
-	for (i = 0; i < HAL_BUFFER_MAX; i++) {
-		struct hal_buffer_requirements *curr_req;
-		bool valid_buffer_type = false;
-
-		curr_req = &inst->buff_req.buffer[i];
-		if (curr_req->buffer_type == HAL_BUFFER_INTERNAL_SCRATCH) {
-			bool is_interlaced = false;
-
-			is_interlaced = (inst->pic_struct ==
-				MSM_VIDC_PIC_STRUCT_MAYBE_INTERLACED);
-			curr_req->buffer_size =
-				dec_calculators->calculate_scratch_size(
-					inst, width, height, is_interlaced,
-					vpp_delay, num_vpp_pipes);
-			valid_buffer_type = true;
-		} else  if (curr_req->buffer_type ==
-			HAL_BUFFER_INTERNAL_SCRATCH_1) {
-			struct msm_vidc_format *fmt = NULL;
-
-			fmt = &inst->fmts[OUTPUT_PORT];
-			out_min_count = fmt->count_min;
-			out_min_count =
-				max(vpp_delay + 1, out_min_count);
-			curr_req->buffer_size =
-				dec_calculators->calculate_scratch1_size(
-					inst, width, height, out_min_count,
-					is_secondary_output_mode(inst),
-					num_vpp_pipes);
-			valid_buffer_type = true;
-		} else if (curr_req->buffer_type ==
-			HAL_BUFFER_INTERNAL_PERSIST_1) {
-			curr_req->buffer_size =
-				dec_calculators->calculate_persist1_size();
-			valid_buffer_type = true;
-		}
-
-		if (valid_buffer_type) {
-			curr_req->buffer_alignment = 256;
-			curr_req->buffer_count_actual =
-				curr_req->buffer_count_min =
-				curr_req->buffer_count_min_host = 1;
-		}
+	key->session_type = MSM_VIDC_DECODER;
+	key->fourcc = f->fmt.pix_mp.pixelformat;
+	key->width = f->fmt.pix_mp.width;
+	key->height = f->fmt.pix_mp.height;
+	key->num_vpp_pipes = inst->core->platform_data->num_vpp_pipes;
+	key->interlaced = (inst->pic_struct ==
+		MSM_VIDC_PIC_STRUCT_MAYBE_INTERLACED);
+	key->vpp_delay = inst->bse_vpp_delay;
+	key->out_min_count = max(key->vpp_delay + 1,
+		inst->fmts[OUTPUT_PORT].count_min);
+	key->split_mode = is_secondary_output_mode(inst);
+
+	if (!msm_vidc_buf_size_cache_get(&inst->core->buf_size_cache, key,
+			&sizes)) {
+		sizes.scratch = dec_calculators->calculate_scratch_size(inst,
+			key->width, key->height, key->interlaced,
+			key->vpp_delay, key->num_vpp_pipes);
+		sizes.scratch1 = dec_calculators->calculate_scratch1_size(inst,
+			key->width, key->height, key->out_min_count,
+			key->split_mode, key->num_vpp_pipes);
+		sizes.persist = dec_calculators->calculate_persist1_size();
+		msm_vidc_buf_size_cache_put(&inst->core->buf_size_cache,
+			&sizes);
 	}
+
+	msm_vidc_set_internal_buffer_sizes(inst, &sizes);
 	return 0;
 }
 
@@ -514,32 +583,24 @@ int msm_vidc_get_num_ref_frames(struct msm_vidc_inst *inst)
 	return num_ref;
 }
 
-int msm_vidc_get_encoder_internal_buffer_sizes(struct msm_vidc_inst *inst)
+static int msm_vidc_get_enc_buf_size_key(struct msm_vidc_inst *inst,
+	struct msm_vidc_enc_buff_size_calculators **calculators,
+	struct msm_vidc_buf_size_key *key)
 {
-	struct msm_vidc_enc_buff_size_calculators *enc_calculators;
-	u32 width, height, i, num_ref, num_vpp_pipes;
-	u32 rotation_val = 0, flip = 0;
-	bool is_tenbit = false, is_downscale = false;
 	int num_bframes;
 	struct v4l2_ctrl *bframe, *rotation, *hflip, *vflip;
 	struct v4l2_format *f;
 
-	if (!inst || !inst->core || !inst->core->platform_data) {
-		d_vpr_e("%s: Instance is null!", __func__);
-		return -EINVAL;
-	}
-
-	num_vpp_pipes = inst->core->platform_data->num_vpp_pipes;
 	f = &inst->fmts[OUTPUT_PORT].v4l2_fmt;
 	switch (f->fmt.pix_mp.pixelformat) {
 	case V4L2_PIX_FMT_H264:
-		enc_calculators = &h264e_calculators;
+		*calculators = &h264e_calculators;
 		break;
 	case V4L2_PIX_FMT_HEVC:
-		enc_calculators = &h265e_calculators;
+		*calculators = &h265e_calculators;
 		break;
 	case V4L2_PIX_FMT_VP8:
-		enc_calculators = &vp8e_calculators;
+		*calculators = &vp8e_calculators;
 		break;
 	default:
 		s_vpr_e(inst->sid,
@@ -554,65 +615,86 @@ int msm_vidc_get_encoder_internal_buffer_sizes(struct msm_vidc_inst *inst)
 		s_vpr_e(inst->sid, "%s: get num bframe failed\n", __func__);
 		return -EINVAL;
 	}
-	f = &inst->fmts[OUTPUT_PORT].v4l2_fmt;
+
+	memset(key, 0, sizeof(*key));
+	/*
+	 * calculate_enc_scratch_size() sizes bitbin buffers from the output
+	 * frame size, which depends on the rc mode, grid and image session
+	 * state. It also applies the grid dimensions to the output format,
+	 * so it runs even when the sizes come from the cache, before the
+	 * dimensions below are read.
+	 */
+	key->bitstream_size = msm_vidc_calculate_enc_output_frame_size(inst);
+	key->rc_type = inst->rc_type;
+	key->grid = is_grid_session(inst);
+	key->image = is_image_session(inst);
+
+	key->session_type = MSM_VIDC_ENCODER;
+	key->fourcc = f->fmt.pix_mp.pixelformat;
+	key->num_vpp_pipes = inst->core->platform_data->num_vpp_pipes;
 	rotation = get_ctrl(inst, V4L2_CID_ROTATE);
-	rotation_val = rotation->val;
-	if (rotation_val == 90 || rotation_val == 270) {
+	key->rotation = rotation->val;
+	if (key->rotation == 90 || key->rotation == 270) {
 		/* Internal buffer size calculators are based on rotated w x h */
-		width = f->fmt.pix_mp.height;
-		height = f->fmt.pix_mp.width;
+		key->width = f->fmt.pix_mp.height;
+		key->height = f->fmt.pix_mp.width;
 	} else {
-		width = f->fmt.pix_mp.width;
-		height = f->fmt.pix_mp.height;
+		key->width = f->fmt.pix_mp.width;
+		key->height = f->fmt.pix_mp.height;
 	}
 	hflip = get_ctrl(inst, V4L2_CID_HFLIP);
 	vflip = get_ctrl(inst, V4L2_CID_VFLIP);
-	flip = hflip->val | vflip->val;
+	key->flip = hflip->val | vflip->val;
 
-	num_ref = msm_vidc_get_num_ref_frames(inst);
-	is_tenbit = (inst->bit_depth == MSM_VIDC_BIT_DEPTH_10);
-	is_downscale = vidc_scalar_enabled(inst);
+	key->num_ref = msm_vidc_get_num_ref_frames(inst);
+	key->ten_bit = (inst->bit_depth == MSM_VIDC_BIT_DEPTH_10);
+	key->downscale = vidc_scalar_enabled(inst);
+	key->work_mode = inst->clk_data.work_mode;
 
-	for (i = 0; i < HAL_BUFFER_MAX; i++) {
-		struct hal_buffer_requirements *curr_req;
-		bool valid_buffer_type = false;
+	return 0;
+}
 
-		curr_req = &inst->buff_req.buffer[i];
-		if (curr_req->buffer_type == HAL_BUFFER_INTERNAL_SCRATCH) {
-			curr_req->buffer_size =
-				enc_calculators->calculate_scratch_size(
-					inst, width, height,
-					inst->clk_data.work_mode,
-					num_vpp_pipes);
-			valid_buffer_type = true;
-		} else  if (curr_req->buffer_type ==
-			HAL_BUFFER_INTERNAL_SCRATCH_1) {
-			curr_req->buffer_size =
-				enc_calculators->calculate_scratch1_size(
-					inst, width, height, num_ref,
-					is_tenbit, num_vpp_pipes);
-			valid_buffer_type = true;
-		} else if (curr_req->buffer_type ==
-			HAL_BUFFER_INTERNAL_SCRATCH_2) {
-			curr_req->buffer_size =
-				enc_calculators->calculate_scratch2_size(
-					inst, width, height, num_ref,
-					is_tenbit, is_downscale, rotation_val, flip);
-			valid_buffer_type = true;
-		} else if (curr_req->buffer_type ==
-			HAL_BUFFER_INTERNAL_PERSIST) {
-			curr_req->buffer_size =
-				enc_calculators->calculate_persist_size();
-			valid_buffer_type = true;
-		}
+static void msm_vidc_calc_enc_buf_sizes(struct msm_vidc_inst *inst,
+	struct msm_vidc_enc_buff_size_calculators *enc_calculators,
+	struct msm_vidc_buf_size_entry *sizes)
+{
+	struct msm_vidc_buf_size_key *key = &sizes->key;
+
+	sizes->scratch = enc_calculators->calculate_scratch_size(inst,
+		key->width, key->height, key->work_mode,
+		key->num_vpp_pipes);
+	sizes->scratch1 = enc_calculators->calculate_scratch1_size(inst,
+		key->width, key->height, key->num_ref, key->ten_bit,
+		key->num_vpp_pipes);
+	sizes->scratch2 = enc_calculators->calculate_scratch2_size(inst,
+		key->width, key->height, key->num_ref, key->ten_bit,
+		key->downscale, key->rotation, key->flip);
+	sizes->persist = enc_calculators->calculate_persist_size();
+}
 
-		if (valid_buffer_type) {
-			curr_req->buffer_alignment = 256;
-			curr_req->buffer_count_actual =
-				curr_req->buffer_count_min =
-				curr_req->buffer_count_min_host = 1;
-		}
+int msm_vidc_get_encoder_internal_buffer_sizes(struct msm_vidc_inst *inst)
+{
+	struct msm_vidc_enc_buff_size_calculators *enc_calculators;
+	struct msm_vidc_buf_size_entry sizes = {0};
+	int rc;
+
+	if (!inst || !inst->core || !inst->core->platform_data) {
+		d_vpr_e("%s: Instance is null!", __func__);
+		return -EINVAL;
 	}
+
+	rc = msm_vidc_get_enc_buf_size_key(inst, &enc_calculators, &sizes.key);
+	if (rc)
+		return rc;
+
+	if (!msm_vidc_buf_size_cache_get(&inst->core->buf_size_cache,
+			&sizes.key, &sizes)) {
+		msm_vidc_calc_enc_buf_sizes(inst, enc_calculators, &sizes);
+		msm_vidc_buf_size_cache_put(&inst->core->buf_size_cache,
+			&sizes);
+	}
+
+	msm_vidc_set_internal_buffer_sizes(inst, &sizes);
 	return 0;
 }
 
@@ -1027,6 +1109,46 @@ calc_done:
 	return ALIGN(frame_size, SZ_4K);
 }
 
+/*
+ * Adaptive bitstream sizing for the encoder capture port: once enough
+ * frames have been encoded, size its buffers from the largest frame seen,
+ * scaled to the current resolution and with headroom, instead of the worst
+ * case for the resolution. An overflow reported by the firmware turns it
+ * back off for the session. Decoders keep the worst case size, as a
+ * truncated input frame has no recovery path.
+ */
+#define ADAPTIVE_BITSTREAM_MIN_FRAMES 30
+#define ADAPTIVE_BITSTREAM_HEADROOM 2
+#define ADAPTIVE_BITSTREAM_MIN_SIZE SZ_256K
+
+u32 msm_vidc_adapt_bitstream_size(struct msm_vidc_inst *inst,
+	u32 frame_size)
+{
+	struct msm_vidc_bitstream_stats *stats = &inst->bitstream_stats;
+	u32 mbs;
+	u64 size;
+
+	if (!msm_vidc_adaptive_bitstream || !is_encode_session(inst) ||
+		is_image_session(inst) || stats->overflow ||
+		stats->frames < ADAPTIVE_BITSTREAM_MIN_FRAMES || !stats->mbs)
+		return frame_size;
+
+	mbs = msm_vidc_get_mbs_per_frame(inst);
+	size = (u64)stats->max_filled_len * ADAPTIVE_BITSTREAM_HEADROOM;
+	if (mbs != stats->mbs)
+		size = div_u64(size * mbs, stats->mbs);
+	size = max_t(u64, size, ADAPTIVE_BITSTREAM_MIN_SIZE);
+	size = ALIGN(size, SZ_4K);
+
+	if (size >= frame_size)
+		return frame_size;
+
+	s_vpr_h(inst->sid,
+		"adaptive bitstream size %llu (worst case %u, max filled %u)\n",
+		size, frame_size, stats->max_filled_len);
+	return (u32)size;
+}
+
 static inline u32 ROI_EXTRADATA_SIZE(
 	u32 width, u32 height, u32 lcu_size) {
 	u32 lcu_width = 0;
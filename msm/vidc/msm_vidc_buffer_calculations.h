@@ -45,5 +45,7 @@ u32 msm_vidc_calculate_enc_input_frame_size(struct msm_vidc_inst *inst);
 u32 msm_vidc_calculate_enc_output_frame_size(struct msm_vidc_inst *inst);
 u32 msm_vidc_calculate_enc_input_extra_size(struct msm_vidc_inst *inst);
 u32 msm_vidc_calculate_enc_output_extra_size(struct msm_vidc_inst *inst);
+u32 msm_vidc_adapt_bitstream_size(struct msm_vidc_inst *inst,
+	u32 frame_size);
 
 #endif // __H_MSM_VIDC_BUFFER_MEM_DEFS_H__
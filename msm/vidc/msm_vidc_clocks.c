@@ -40,6 +40,7 @@ struct msm_vidc_core_ops core_ops_iris2 = {
 	.decide_work_mode = msm_vidc_decide_work_mode_iris2,
 	.decide_core_and_power_mode = msm_vidc_decide_core_and_power_mode_iris2,
 	.calc_bw = calc_bw_iris2,
+	.balance_core = msm_vidc_balance_core_iris2,
 };
 
 static inline unsigned long get_ubwc_compression_ratio(
@@ -1471,26 +1472,116 @@ int msm_vidc_decide_core_and_power_mode_ar50lt(struct msm_vidc_inst *inst)
 	return 0;
 }
 
-int msm_vidc_decide_core_and_power_mode_iris2(struct msm_vidc_inst *inst)
+struct msm_vidc_power_mode_change {
+	struct msm_vidc_inst *inst;
+	bool enable;
+};
+
+/*
+ * Hand out the HQ budget (max_hq_mbs_per_sec) across all active encoders
+ * on the core instead of per session, realtime sessions first, so that
+ * concurrent encodes are moved to power save mode before the pipes
+ * saturate and get HQ back when load drops. Work route and work mode are
+ * session parameters fixed at start, so the runtime balance is done on
+ * the power mode only.
+ *
+ * Called with core->lock held; sessions whose mode changes are pinned and
+ * returned in @changes, to be applied under their own lock afterwards.
+ */
+static void msm_vidc_balance_power_mode(struct msm_vidc_core *core,
+	bool realtime, u64 *hq_load,
+	struct msm_vidc_power_mode_change *changes, int *count)
 {
-	u32 mbpf, mbps, max_hq_mbpf, max_hq_mbps;
-	bool enable = true;
-	int rc = 0;
+	struct msm_vidc_inst *inst;
+	u32 mbpf, max_hq_mbpf, max_hq_mbps;
+	int load;
+	bool enable;
 
-	inst->clk_data.core_id = VIDC_CORE_ID_1;
+	max_hq_mbpf = core->resources.max_hq_mbs_per_frame;
+	max_hq_mbps = core->resources.max_hq_mbs_per_sec;
+
+	list_for_each_entry(inst, &core->instances, list) {
+		if (!is_encode_session(inst) ||
+			is_realtime_session(inst) != realtime)
+			continue;
+		load = msm_comm_get_inst_load_per_core(inst, LOAD_POWER);
+		if (!load)
+			continue;
+		mbpf = msm_vidc_get_mbs_per_frame(inst);
 
-	mbpf = msm_vidc_get_mbs_per_frame(inst);
-	mbps = mbpf * msm_vidc_get_fps(inst);
-	max_hq_mbpf = inst->core->resources.max_hq_mbs_per_frame;
-	max_hq_mbps = inst->core->resources.max_hq_mbs_per_sec;
+		/* Power saving always disabled for CQ and LOSSLESS RC modes. */
+		enable = true;
+		if (inst->rc_type == V4L2_MPEG_VIDEO_BITRATE_MODE_CQ ||
+			inst->rc_type == RATE_CONTROL_LOSSLESS ||
+			(mbpf <= max_hq_mbpf &&
+			 *hq_load + load <= max_hq_mbps))
+			enable = false;
+		if (!enable)
+			*hq_load += load;
+
+		if (!!(inst->flags & VIDC_LOW_POWER) == enable &&
+			inst->clk_data.power_mode_set)
+			continue;
+		if (*count == MAX_SUPPORTED_INSTANCES_24 ||
+			!kref_get_unless_zero(&inst->kref))
+			continue;
+		changes[*count].inst = inst;
+		changes[*count].enable = enable;
+		(*count)++;
+	}
+}
 
-	/* Power saving always disabled for CQ and LOSSLESS RC modes. */
-	if (inst->rc_type == V4L2_MPEG_VIDEO_BITRATE_MODE_CQ ||
-		inst->rc_type == RATE_CONTROL_LOSSLESS ||
-		(mbpf <= max_hq_mbpf && mbps <= max_hq_mbps))
-		enable = false;
+/*
+ * Rebalances the power mode of the encoders on the core and returns the
+ * result of applying it to @cur, if @cur's mode had to be set.
+ */
+static int msm_vidc_balance_core(struct msm_vidc_core *core,
+	struct msm_vidc_inst *cur)
+{
+	struct msm_vidc_power_mode_change changes[MAX_SUPPORTED_INSTANCES_24];
+	struct msm_vidc_inst *inst;
+	u64 hq_load = 0;
+	int i, count = 0, rc, cur_rc = 0;
+
+	mutex_lock(&core->lock);
+	msm_vidc_balance_power_mode(core, true, &hq_load, changes, &count);
+	msm_vidc_balance_power_mode(core, false, &hq_load, changes, &count);
+	mutex_unlock(&core->lock);
+
+	for (i = 0; i < count; i++) {
+		inst = changes[i].inst;
+		mutex_lock(&inst->lock);
+		rc = 0;
+		if (inst->state < MSM_VIDC_STOP_DONE) {
+			rc = msm_vidc_power_save_mode_enable(inst,
+				changes[i].enable);
+			if (!rc)
+				inst->clk_data.power_mode_set = true;
+		}
+		mutex_unlock(&inst->lock);
+		if (inst == cur)
+			cur_rc = rc;
+		put_inst(inst);
+	}
+
+	return cur_rc;
+}
+
+void msm_vidc_balance_core_iris2(struct msm_vidc_core *core)
+{
+	msm_vidc_balance_core(core, NULL);
+}
+
+int msm_vidc_decide_core_and_power_mode_iris2(struct msm_vidc_inst *inst)
+{
+	int rc;
+
+	mutex_lock(&inst->lock);
+	inst->clk_data.core_id = VIDC_CORE_ID_1;
+	inst->clk_data.power_mode_set = false;
+	mutex_unlock(&inst->lock);
 
-	rc = msm_vidc_power_save_mode_enable(inst, enable);
+	rc = msm_vidc_balance_core(inst->core, inst);
 	msm_print_core_status(inst->core, VIDC_CORE_ID_1, inst->sid);
 
 	return rc;
@@ -1526,7 +1617,7 @@ void msm_print_core_status(struct msm_vidc_core *core, u32 core_id, u32 sid)
 		out_f = &inst->fmts[OUTPUT_PORT].v4l2_fmt;
 		inp_f = &inst->fmts[INPUT_PORT].v4l2_fmt;
 		s_vpr_p(sid,
-			"inst %pK (%4ux%4u) to (%4ux%4u) %3u %s %s %u %s %s %lu\n",
+			"inst %pK (%4ux%4u) to (%4ux%4u) %3u %s %s %u %s %s %lu %d\n",
 			inst,
 			inp_f->fmt.pix_mp.width,
 			inp_f->fmt.pix_mp.height,
@@ -1539,7 +1630,8 @@ void msm_print_core_status(struct msm_vidc_core *core, u32 core_id, u32 sid)
 			inst->clk_data.work_route,
 			inst->flags & VIDC_LOW_POWER ? "LP" : "HQ",
 			is_realtime_session(inst) ? "RealTime" : "NonRTime",
-			inst->clk_data.min_freq);
+			inst->clk_data.min_freq,
+			msm_comm_get_inst_load_per_core(inst, LOAD_POWER));
 	}
 	mutex_unlock(&core->lock);
 }
@@ -29,6 +29,7 @@ int msm_vidc_decide_work_mode_iris2(struct msm_vidc_inst *inst);
 int msm_vidc_decide_core_and_power_mode_ar50lt(struct msm_vidc_inst *inst);
 int msm_vidc_decide_core_and_power_mode_iris1(struct msm_vidc_inst *inst);
 int msm_vidc_decide_core_and_power_mode_iris2(struct msm_vidc_inst *inst);
+void msm_vidc_balance_core_iris2(struct msm_vidc_core *core);
 void msm_print_core_status(struct msm_vidc_core *core, u32 core_id, u32 sid);
 void msm_comm_free_input_cr_table(struct msm_vidc_inst *inst);
 void msm_comm_update_input_cr(struct msm_vidc_inst *inst, u32 index,
@@ -3,6 +3,7 @@
  * Copyright (c) 2012-2021, The Linux Foundation. All rights reserved.
  */
 
+#include <linux/sort.h>
 #include <soc/qcom/subsystem_restart.h>
 #include "msm_vidc_common.h"
 #include "vidc_hfi_api.h"
@@ -521,19 +522,116 @@ static bool is_priv_ctrl(u32 id)
 	return false;
 }
 
+static int msm_comm_ctrl_cfg_cmp(const void *a, const void *b)
+{
+	u32 id_a = ((const struct v4l2_ctrl_config *)a)->id;
+	u32 id_b = ((const struct v4l2_ctrl_config *)b)->id;
+
+	return id_a < id_b ? -1 : id_a > id_b;
+}
+
+/*
+ * Converts a driver control table into v4l2 control configs once per
+ * core and session type. Standard controls get their name, type and
+ * flags resolved here so that instances only need v4l2_ctrl_new_custom(),
+ * and the table is sorted by id so that get_ctrl() can bisect.
+ */
+static struct v4l2_ctrl_config *msm_comm_ctrl_template(
+		struct msm_vidc_inst *inst, struct msm_vidc_ctrl *drv_ctrls,
+		u32 num_ctrls, const struct v4l2_ctrl_ops *ctrl_ops)
+{
+	struct msm_vidc_core *core = inst->core;
+	struct v4l2_ctrl_config *tmpl, *cfg;
+	const char *name;
+	enum v4l2_ctrl_type type;
+	s64 min, max, def;
+	u64 step;
+	u32 flags, idx;
+
+	tmpl = core->ctrl_tmpl[inst->session_type];
+	if (tmpl)
+		return tmpl;
+
+	tmpl = kcalloc(num_ctrls, sizeof(*tmpl), GFP_KERNEL);
+	if (!tmpl) {
+		s_vpr_e(inst->sid, "%s: failed to allocate template\n",
+			__func__);
+		return NULL;
+	}
+
+	for (idx = 0; idx < num_ctrls; idx++) {
+		cfg = &tmpl[idx];
+		cfg->ops = ctrl_ops;
+		cfg->id = drv_ctrls[idx].id;
+		cfg->min = drv_ctrls[idx].minimum;
+		cfg->max = drv_ctrls[idx].maximum;
+		cfg->step = drv_ctrls[idx].step;
+		cfg->def = drv_ctrls[idx].default_value;
+		cfg->menu_skip_mask = drv_ctrls[idx].menu_skip_mask;
+		cfg->flags = drv_ctrls[idx].flags |
+			V4L2_CTRL_FLAG_EXECUTE_ON_WRITE;
+
+		if (is_priv_ctrl(drv_ctrls[idx].id)) {
+			/*add private control*/
+			cfg->name = drv_ctrls[idx].name;
+			cfg->type = drv_ctrls[idx].type;
+			cfg->qmenu = drv_ctrls[idx].qmenu;
+			continue;
+		}
+
+		v4l2_ctrl_fill(cfg->id, &name, &type, &min, &max, &step,
+			&def, &flags);
+		cfg->name = name;
+		cfg->type = type;
+		cfg->flags |= flags;
+		if (drv_ctrls[idx].type == V4L2_CTRL_TYPE_MENU) {
+			cfg->max = (u8) drv_ctrls[idx].maximum;
+			cfg->def = (u8) drv_ctrls[idx].default_value;
+			cfg->qmenu = v4l2_ctrl_get_menu(cfg->id);
+		}
+		if (cfg->type == V4L2_CTRL_TYPE_MENU && !cfg->qmenu) {
+			s_vpr_e(inst->sid, "%s: invalid ctrl %s\n", __func__,
+				drv_ctrls[idx].name);
+			kfree(tmpl);
+			return NULL;
+		}
+	}
+	sort(tmpl, num_ctrls, sizeof(*tmpl), msm_comm_ctrl_cfg_cmp, NULL);
+
+	core->ctrl_tmpl[inst->session_type] = tmpl;
+	return tmpl;
+}
+
+void msm_comm_ctrl_templates_free(struct msm_vidc_core *core)
+{
+	int i;
+
+	for (i = 0; i < MSM_VIDC_MAX_DEVICES; i++) {
+		kfree(core->ctrl_tmpl[i]);
+		core->ctrl_tmpl[i] = NULL;
+	}
+}
+
 int msm_comm_ctrl_init(struct msm_vidc_inst *inst,
 		struct msm_vidc_ctrl *drv_ctrls, u32 num_ctrls,
 		const struct v4l2_ctrl_ops *ctrl_ops)
 {
 	int idx = 0;
-	struct v4l2_ctrl_config ctrl_cfg = {0};
+	struct v4l2_ctrl_config *tmpl;
 	int ret_val = 0;
 
-	if (!inst || !drv_ctrls || !ctrl_ops || !num_ctrls) {
+	if (!inst || !inst->core || !drv_ctrls || !ctrl_ops || !num_ctrls ||
+		inst->session_type >= MSM_VIDC_MAX_DEVICES) {
 		d_vpr_e("%s: invalid input\n", __func__);
 		return -EINVAL;
 	}
 
+	mutex_lock(&inst->core->lock);
+	tmpl = msm_comm_ctrl_template(inst, drv_ctrls, num_ctrls, ctrl_ops);
+	mutex_unlock(&inst->core->lock);
+	if (!tmpl)
+		return -EINVAL;
+
 	inst->ctrls = kcalloc(num_ctrls, sizeof(struct v4l2_ctrl *),
 				GFP_KERNEL);
 	if (!inst->ctrls) {
@@ -550,48 +648,13 @@ int msm_comm_ctrl_init(struct msm_vidc_inst *inst,
 	}
 
 	for (; idx < (int) num_ctrls; idx++) {
-		struct v4l2_ctrl *ctrl = NULL;
-
-		if (is_priv_ctrl(drv_ctrls[idx].id)) {
-			/*add private control*/
-			ctrl_cfg.def = drv_ctrls[idx].default_value;
-			ctrl_cfg.flags = 0;
-			ctrl_cfg.id = drv_ctrls[idx].id;
-			ctrl_cfg.max = drv_ctrls[idx].maximum;
-			ctrl_cfg.min = drv_ctrls[idx].minimum;
-			ctrl_cfg.menu_skip_mask =
-				drv_ctrls[idx].menu_skip_mask;
-			ctrl_cfg.name = drv_ctrls[idx].name;
-			ctrl_cfg.ops = ctrl_ops;
-			ctrl_cfg.step = drv_ctrls[idx].step;
-			ctrl_cfg.type = drv_ctrls[idx].type;
-			ctrl_cfg.qmenu = drv_ctrls[idx].qmenu;
-
-			ctrl = v4l2_ctrl_new_custom(&inst->ctrl_handler,
-					&ctrl_cfg, NULL);
-		} else {
-			if (drv_ctrls[idx].type == V4L2_CTRL_TYPE_MENU) {
-				ctrl = v4l2_ctrl_new_std_menu(
-					&inst->ctrl_handler,
-					ctrl_ops,
-					drv_ctrls[idx].id,
-					(u8) drv_ctrls[idx].maximum,
-					drv_ctrls[idx].menu_skip_mask,
-					(u8) drv_ctrls[idx].default_value);
-			} else {
-				ctrl = v4l2_ctrl_new_std(&inst->ctrl_handler,
-					ctrl_ops,
-					drv_ctrls[idx].id,
-					drv_ctrls[idx].minimum,
-					drv_ctrls[idx].maximum,
-					drv_ctrls[idx].step,
-					drv_ctrls[idx].default_value);
-			}
-		}
+		struct v4l2_ctrl *ctrl;
 
+		ctrl = v4l2_ctrl_new_custom(&inst->ctrl_handler,
+				&tmpl[idx], NULL);
 		if (!ctrl) {
 			s_vpr_e(inst->sid, "%s: invalid ctrl %s\n", __func__,
-				 drv_ctrls[idx].name);
+				 tmpl[idx].name);
 			return -EINVAL;
 		}
 
@@ -599,12 +662,10 @@ int msm_comm_ctrl_init(struct msm_vidc_inst *inst,
 		if (ret_val) {
 			s_vpr_e(inst->sid,
 				"Error adding ctrl (%s) to ctrl handle, %d\n",
-				drv_ctrls[idx].name, inst->ctrl_handler.error);
+				tmpl[idx].name, inst->ctrl_handler.error);
 			return ret_val;
 		}
 
-		ctrl->flags |= drv_ctrls[idx].flags;
-		ctrl->flags |= V4L2_CTRL_FLAG_EXECUTE_ON_WRITE;
 		inst->ctrls[idx] = ctrl;
 	}
 	inst->num_ctrls = num_ctrls;
@@ -739,16 +800,17 @@ static int msm_comm_get_mbs_per_sec(struct msm_vidc_inst *inst,
 	return max(input_port_mbs, output_port_mbs) * fps;
 }
 
-int msm_comm_get_inst_load(struct msm_vidc_inst *inst,
+/* same as msm_comm_get_inst_load(), called with inst->lock held */
+int __msm_comm_get_inst_load_locked(struct msm_vidc_inst *inst,
 		enum load_calc_quirks quirks)
 {
 	int load = 0;
 
-	mutex_lock(&inst->lock);
+	lockdep_assert_held(&inst->lock);
 
 	if (!(inst->state >= MSM_VIDC_OPEN_DONE &&
 		inst->state < MSM_VIDC_STOP_DONE))
-		goto exit;
+		return 0;
 
 	/*  Clock and Load calculations for REALTIME/NON-REALTIME
 	 *  Operating rate will either Default or Client value.
@@ -779,8 +841,18 @@ int msm_comm_get_inst_load(struct msm_vidc_inst *inst,
 		load = msm_comm_get_mbs_per_sec(inst, quirks);
 	}
 
-exit:
+	return load;
+}
+
+int msm_comm_get_inst_load(struct msm_vidc_inst *inst,
+		enum load_calc_quirks quirks)
+{
+	int load;
+
+	mutex_lock(&inst->lock);
+	load = __msm_comm_get_inst_load_locked(inst, quirks);
 	mutex_unlock(&inst->lock);
+
 	return load;
 }
 
@@ -1105,21 +1177,26 @@ struct msm_vidc_inst *get_inst(struct msm_vidc_core *core,
 	if (!core || !inst_id)
 		return NULL;
 
-	mutex_lock(&core->lock);
 	/*
+	 * Completion callbacks only read core->instances, so walk it under
+	 * RCU rather than core->lock; instances are unlinked with
+	 * list_del_rcu() and freed after a grace period, so a stale inst_id
+	 * is only ever compared against, never dereferenced.
+	 *
 	 * This is as good as !list_empty(!inst->list), but at this point
 	 * we don't really know if inst was kfree'd via close syscall before
 	 * hardware could respond.  So manually walk thru the list of active
 	 * sessions
 	 */
-	list_for_each_entry(inst, &core->instances, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(inst, &core->instances, list) {
 		if (inst == inst_id) {
 			/*
 			 * Even if the instance is valid, we really shouldn't
 			 * be receiving or handling callbacks when we've deleted
 			 * our session with HFI
 			 */
-			matches = !!inst->session;
+			matches = !!READ_ONCE(inst->session);
 			break;
 		}
 	}
@@ -1130,7 +1207,7 @@ struct msm_vidc_inst *get_inst(struct msm_vidc_core *core,
 	 * locking system.
 	 */
 	inst = (matches && kref_get_unless_zero(&inst->kref)) ? inst : NULL;
-	mutex_unlock(&core->lock);
+	rcu_read_unlock();
 
 	return inst;
 }
@@ -2042,6 +2119,24 @@ int msm_comm_queue_dpb_only_buffers(struct msm_vidc_inst *inst)
 	return rc;
 }
 
+static void msm_comm_update_flush_stats(struct msm_vidc_inst *inst)
+{
+	struct msm_vidc_flush_stats *stats = &inst->flush_stats;
+	u32 us;
+
+	if (!stats->start_ns)
+		return;
+
+	us = (u32)div_u64(ktime_get_ns() - stats->start_ns, NSEC_PER_USEC);
+	stats->count++;
+	stats->last_us = us;
+	stats->max_us = max(stats->max_us, us);
+	stats->avg_us = stats->count == 1 ? us :
+		(stats->avg_us * 7 + us) / 8;
+	stats->fbd_pending = true;
+	s_vpr_h(inst->sid, "flush done in %u us\n", us);
+}
+
 static void handle_session_flush(enum hal_command_response cmd, void *data)
 {
 	struct msm_vidc_cb_cmd_done *response = data;
@@ -2067,8 +2162,11 @@ static void handle_session_flush(enum hal_command_response cmd, void *data)
 		mutex_lock(&inst->bufq[INPUT_PORT].lock);
 	if (response->data.flush_type & HAL_FLUSH_OUTPUT)
 		mutex_lock(&inst->bufq[OUTPUT_PORT].lock);
+	msm_comm_update_flush_stats(inst);
+	/* DPBs stay queued in firmware across an input only flush */
 	if (msm_comm_get_stream_output_mode(inst) ==
-			HAL_VIDEO_DECODER_SECONDARY) {
+			HAL_VIDEO_DECODER_SECONDARY &&
+			(response->data.flush_type & HAL_FLUSH_OUTPUT)) {
 
 		if (!(get_v4l2_codec(inst) == V4L2_PIX_FMT_VP9 &&
 				inst->in_reconfig))
@@ -2168,6 +2266,7 @@ static void handle_session_error(enum hal_command_response cmd, void *data)
 	}
 
 	/* change state before sending error to client */
+	inst->release_res_posted = false;
 	change_inst_state(inst, MSM_VIDC_CORE_INVALID);
 	msm_vidc_queue_v4l2_event(inst, event);
 	s_vpr_l(inst->sid, "handled: SESSION_ERROR\n");
@@ -2654,8 +2753,9 @@ static void handle_fbd(enum hal_command_response cmd, void *data)
 		s_vpr_e(inst->sid, "Failed to store input tag");
 
 	if (inst->session_type == MSM_VIDC_ENCODER) {
-		if (inst->max_filled_len < fill_buf_done->filled_len1)
-			inst->max_filled_len = fill_buf_done->filled_len1;
+		msm_comm_update_bitstream_stats(inst,
+			fill_buf_done->offset1 + fill_buf_done->filled_len1,
+			response->status == VIDC_ERR_INSUFFICIENT_BUFFER);
 	}
 
 	f = &inst->fmts[OUTPUT_PORT].v4l2_fmt;
@@ -2671,7 +2771,8 @@ static void handle_fbd(enum hal_command_response cmd, void *data)
 		mbuf->vvb.flags |= V4L2_BUF_FLAG_CODECCONFIG;
 	if (fill_buf_done->flags1 & HAL_BUFFERFLAG_SYNCFRAME)
 		mbuf->vvb.flags |= V4L2_BUF_FLAG_KEYFRAME;
-	if (fill_buf_done->flags1 & HAL_BUFFERFLAG_DATACORRUPT)
+	if (fill_buf_done->flags1 & HAL_BUFFERFLAG_DATACORRUPT ||
+		response->status == VIDC_ERR_INSUFFICIENT_BUFFER)
 		mbuf->vvb.flags |= V4L2_BUF_FLAG_DATA_CORRUPT;
 	if (fill_buf_done->flags1 & HAL_BUFFERFLAG_ENDOFSUBFRAME)
 		mbuf->vvb.flags |= V4L2_BUF_FLAG_END_OF_SUBFRAME;
@@ -2721,6 +2822,11 @@ static void handle_fbd(enum hal_command_response cmd, void *data)
 	msm_comm_put_vidc_buffer(inst, mbuf);
 	msm_comm_vb2_buffer_done(inst, mbuf);
 	msm_vidc_debugfs_update(inst, MSM_VIDC_DEBUGFS_EVENT_FBD);
+	if (inst->flush_stats.fbd_pending && vb->planes[0].bytesused) {
+		inst->flush_stats.fbd_pending = false;
+		inst->flush_stats.first_fbd_us = (u32)div_u64(ktime_get_ns() -
+			inst->flush_stats.start_ns, NSEC_PER_USEC);
+	}
 	kref_put_mbuf(mbuf);
 
 exit:
@@ -3011,6 +3117,46 @@ exit:
 	return rc;
 }
 
+/* Called with core->lock held, when a session opens on an idle core */
+static void msm_comm_update_fw_reopen_gap(struct msm_vidc_core *core,
+		bool warm)
+{
+	u64 gap_ms;
+
+	if (!core->fw_idle_ns || !list_is_singular(&core->instances))
+		return;
+
+	gap_ms = div_u64(ktime_get_ns() - core->fw_idle_ns, NSEC_PER_MSEC);
+	core->fw_idle_ns = 0;
+	if (warm)
+		core->fw_warm_opens++;
+	else
+		core->fw_cold_opens++;
+
+	/* a long idle period is a genuine cold start, not a burst */
+	if (gap_ms > 2 * (u64)msm_vidc_fw_retain_max_ms)
+		return;
+
+	core->fw_reopen_gap_ms = core->fw_reopen_gap_ms ?
+		(core->fw_reopen_gap_ms * 3 + (u32)gap_ms) >> 2 : (u32)gap_ms;
+}
+
+/*
+ * Keep the firmware loaded for about twice the usual close-to-open gap
+ * so that bursts of short sessions stay warm, never beyond
+ * msm_vidc_fw_retain_max_ms and never below the platform delay.
+ */
+static u32 msm_comm_fw_unload_delay(struct msm_vidc_core *core)
+{
+	u32 delay_ms = core->resources.msm_vidc_firmware_unload_delay;
+
+	if (!msm_vidc_fw_retain_max_ms || !core->fw_reopen_gap_ms)
+		return delay_ms;
+
+	return max_t(u32, delay_ms, min_t(u32, core->fw_reopen_gap_ms * 2,
+		msm_vidc_fw_retain_max_ms));
+}
+
 static int msm_comm_init_core_done(struct msm_vidc_inst *inst)
 {
 	int rc = 0;
@@ -3040,8 +3186,10 @@ static int msm_comm_init_core(struct msm_vidc_inst *inst)
 	if (core->state >= VIDC_CORE_INIT) {
 		s_vpr_h(inst->sid, "Video core: %d is already in state: %d\n",
 				core->id, core->state);
+		msm_comm_update_fw_reopen_gap(core, true);
 		goto core_already_inited;
 	}
+	msm_comm_update_fw_reopen_gap(core, false);
 	s_vpr_h(inst->sid, "%s: core %pK\n", __func__, core);
 	rc = call_hfi_op(hdev, core_init, hdev->hfi_device_data);
 	if (rc) {
@@ -3067,20 +3215,19 @@ static int msm_comm_init_core(struct msm_vidc_inst *inst)
 		rc = -EINVAL;
 		goto fail_core_init;
 	}
+	/* capabilities are platform derived, keep them across unloads */
+	if (core->capabilities) {
+		s_vpr_h(inst->sid, "%s: using cached capabilities\n",
+			__func__);
+		goto core_caps_done;
+	}
+	core->capabilities = kcalloc(core->resources.codecs_count,
+		sizeof(struct msm_vidc_capability), GFP_KERNEL);
 	if (!core->capabilities) {
-		core->capabilities = kcalloc(core->resources.codecs_count,
-			sizeof(struct msm_vidc_capability), GFP_KERNEL);
-		if (!core->capabilities) {
-			s_vpr_e(inst->sid,
-				"%s: failed to allocate capabilities\n",
-				__func__);
-			rc = -ENOMEM;
-			goto fail_core_init;
-		}
-	} else {
 		s_vpr_e(inst->sid,
-			"%s: capabilities memory is expected to be freed\n",
-			__func__);
+			"%s: failed to allocate capabilities\n", __func__);
+		rc = -ENOMEM;
+		goto fail_core_init;
 	}
 	for (i = 0; i < core->resources.codecs_count; i++) {
 		core->capabilities[i].domain =
@@ -3096,6 +3243,7 @@ static int msm_comm_init_core(struct msm_vidc_inst *inst)
 		core->capabilities = NULL;
 		goto fail_core_init;
 	}
+core_caps_done:
 	s_vpr_h(inst->sid, "%s: done\n", __func__);
 core_already_inited:
 	change_inst_state(inst, MSM_VIDC_CORE_INIT);
@@ -3114,6 +3262,7 @@ static int msm_vidc_deinit_core(struct msm_vidc_inst *inst)
 {
 	struct msm_vidc_core *core;
 	struct hfi_device *hdev;
+	u32 delay_ms;
 
 	if (!inst || !inst->core || !inst->core->device) {
 		d_vpr_e("%s: invalid parameters\n", __func__);
@@ -3144,15 +3293,19 @@ static int msm_vidc_deinit_core(struct msm_vidc_inst *inst)
 		 * will have a burst of back to back video playback sessions
 		 * e.g. thumbnail generation.
 		 */
+		delay_ms = core->state == VIDC_CORE_INIT_DONE ?
+			msm_comm_fw_unload_delay(core) : 0;
 		schedule_delayed_work(&core->fw_unload_work,
-			msecs_to_jiffies(core->state == VIDC_CORE_INIT_DONE ?
-			core->resources.msm_vidc_firmware_unload_delay : 0));
+			msecs_to_jiffies(delay_ms));
 
 		s_vpr_h(inst->sid, "firmware unload delayed by %u ms\n",
-			core->state == VIDC_CORE_INIT_DONE ?
-			core->resources.msm_vidc_firmware_unload_delay : 0);
+			delay_ms);
 	}
 
+	/* last session going away, time the next open against it */
+	if (list_is_singular(&core->instances))
+		core->fw_idle_ns = ktime_get_ns();
+
 core_already_uninited:
 	change_inst_state(inst, MSM_VIDC_CORE_UNINIT);
 	mutex_unlock(&core->lock);
@@ -3604,6 +3757,7 @@ static int msm_vidc_stop(int flipped_state, struct msm_vidc_inst *inst)
 	}
 	hdev = inst->core->device;
 	s_vpr_h(inst->sid, "%s: inst %pK\n", __func__, inst);
+	inst->release_res_posted = false;
 	rc = call_hfi_op(hdev, session_stop, (void *) inst->session);
 	if (rc) {
 		s_vpr_e(inst->sid, "%s: inst %pK session_stop failed\n",
@@ -3636,16 +3790,43 @@ static int msm_vidc_release_res(int flipped_state, struct msm_vidc_inst *inst)
 	}
 	hdev = inst->core->device;
 	s_vpr_h(inst->sid, "%s: inst %pK\n", __func__, inst);
-	rc = call_hfi_op(hdev, session_release_res, (void *) inst->session);
-	if (rc) {
-		s_vpr_e(inst->sid, "Failed to send release resources\n");
-		goto exit;
+	if (inst->release_res_posted) {
+		/* already queued right behind SESSION_STOP */
+		inst->release_res_posted = false;
+	} else {
+		rc = call_hfi_op(hdev, session_release_res,
+				(void *) inst->session);
+		if (rc) {
+			s_vpr_e(inst->sid,
+				"Failed to send release resources\n");
+			goto exit;
+		}
 	}
 	change_inst_state(inst, MSM_VIDC_RELEASE_RESOURCES);
 exit:
 	return rc;
 }
 
+/*
+ * The host has nothing to do between STOP_DONE and RELEASE_RESOURCES, so
+ * queue RELEASE_RESOURCES behind STOP and collect both acks afterwards.
+ * Firmware handles session commands in order.
+ */
+static void msm_vidc_post_release_res(struct msm_vidc_inst *inst)
+{
+	struct hfi_device *hdev = inst->core->device;
+
+	if (inst->state != MSM_VIDC_STOP)
+		return;
+
+	if (call_hfi_op(hdev, session_release_res, (void *) inst->session)) {
+		s_vpr_e(inst->sid, "%s: failed, retry after stop done\n",
+			__func__);
+		return;
+	}
+	inst->release_res_posted = true;
+}
+
 static int msm_comm_session_close(int flipped_state,
 			struct msm_vidc_inst *inst)
 {
@@ -3876,9 +4057,9 @@ static int set_dpb_only_buffers(struct msm_vidc_inst *inst,
 			rc = -ENOMEM;
 			goto fail_kzalloc;
 		}
-		rc = msm_comm_smem_alloc(inst,
-			f->fmt.pix_mp.plane_fmt[1].sizeimage, 1, smem_flags,
-			buffer_type, 0, &inst->dpb_extra_binfo->smem);
+		rc = msm_comm_internal_smem_alloc(inst,
+			f->fmt.pix_mp.plane_fmt[1].sizeimage, smem_flags,
+			buffer_type, &inst->dpb_extra_binfo->smem);
 		if (rc) {
 			s_vpr_e(inst->sid,
 				"Failed to allocate output memory\n");
@@ -3897,9 +4078,9 @@ static int set_dpb_only_buffers(struct msm_vidc_inst *inst,
 				rc = -ENOMEM;
 				goto fail_kzalloc;
 			}
-			rc = msm_comm_smem_alloc(inst,
-					buffer_size, 1, smem_flags,
-					buffer_type, 0, &binfo->smem);
+			rc = msm_comm_internal_smem_alloc(inst,
+					buffer_size, smem_flags,
+					buffer_type, &binfo->smem);
 			if (rc) {
 				s_vpr_e(inst->sid,
 					"Failed to allocate output memory\n");
@@ -3939,7 +4120,7 @@ static int set_dpb_only_buffers(struct msm_vidc_inst *inst,
 	}
 	return rc;
 fail_set_buffers:
-	msm_comm_smem_free(inst, &binfo->smem);
+	msm_comm_internal_smem_free(inst, &binfo->smem);
 err_no_mem:
 	kfree(binfo);
 fail_kzalloc:
@@ -4071,9 +4252,9 @@ static int allocate_and_set_internal_bufs(struct msm_vidc_inst *inst,
 			rc = -ENOMEM;
 			goto fail_kzalloc;
 		}
-		rc = msm_comm_smem_alloc(inst, internal_bufreq->buffer_size,
-				1, smem_flags, internal_bufreq->buffer_type,
-				0, &binfo->smem);
+		rc = msm_comm_internal_smem_alloc(inst,
+				internal_bufreq->buffer_size, smem_flags,
+				internal_bufreq->buffer_type, &binfo->smem);
 		if (rc) {
 			s_vpr_e(inst->sid,
 				"Failed to allocate scratch memory\n");
@@ -4094,7 +4275,7 @@ static int allocate_and_set_internal_bufs(struct msm_vidc_inst *inst,
 	return rc;
 
 fail_set_buffers:
-	msm_comm_smem_free(inst, &binfo->smem);
+	msm_comm_internal_smem_free(inst, &binfo->smem);
 err_no_mem:
 	kfree(binfo);
 fail_kzalloc:
@@ -4189,6 +4370,8 @@ int msm_comm_try_state(struct msm_vidc_inst *inst, int state)
 		rc = msm_vidc_stop(flipped_state, inst);
 		if (rc || state <= get_flipped_state(inst->state, state))
 			break;
+		if (state >= MSM_VIDC_RELEASE_RESOURCES)
+			msm_vidc_post_release_res(inst);
 	case MSM_VIDC_STOP_DONE:
 		rc = wait_for_state(inst, flipped_state, MSM_VIDC_STOP_DONE,
 				HAL_SESSION_STOP_DONE);
@@ -4234,6 +4417,8 @@ exit:
 	if (rc) {
 		s_vpr_e(inst->sid, "Failed to move from state: %d to %d\n",
 			inst->state, state);
+		/* a posted RELEASE_RESOURCES never gets collected now */
+		inst->release_res_posted = false;
 		msm_comm_kill_session(inst);
 	} else {
 		trace_msm_vidc_common_state_change((void *)inst,
@@ -4369,6 +4554,66 @@ int msm_vidc_comm_cmd(void *instance, union msm_v4l2_cmd *cmd)
 	return rc;
 }
 
+/*
+ * The encoder truncated a frame into an undersized bitstream buffer. Fall
+ * back to the worst case size and, if adaptive sizing had shrunk the port
+ * below it, ask the client to reallocate through the insufficient event.
+ * The truncated frame itself is returned with V4L2_BUF_FLAG_DATA_CORRUPT,
+ * so clients that don't subscribe to the event still see the loss.
+ */
+static void msm_comm_handle_bitstream_overflow(struct msm_vidc_inst *inst)
+{
+	struct msm_vidc_format *fmt = &inst->fmts[OUTPUT_PORT];
+	struct v4l2_pix_format_mplane *mplane = &fmt->v4l2_fmt.fmt.pix_mp;
+	struct v4l2_event event = {0};
+	u32 *ptr = (u32 *)event.u.data;
+	u32 size;
+
+	size = msm_vidc_calculate_enc_output_frame_size(inst);
+	s_vpr_e(inst->sid,
+		"bitstream overflow, buffer size %u worst case %u\n",
+		mplane->plane_fmt[0].sizeimage, size);
+	if (mplane->plane_fmt[0].sizeimage >= size)
+		return;
+
+	mplane->plane_fmt[0].sizeimage = size;
+	ptr[MSM_VIDC_HEIGHT] = mplane->height;
+	ptr[MSM_VIDC_WIDTH] = mplane->width;
+	ptr[MSM_VIDC_FW_MIN_COUNT] = fmt->count_min;
+	event.type = V4L2_EVENT_MSM_VIDC_PORT_SETTINGS_CHANGED_INSUFFICIENT;
+	v4l2_event_queue_fh(&inst->event_handler, &event);
+}
+
+/*
+ * Tracks the filled length of compressed buffers for adaptive sizing.
+ * @overflow is set when the encoder reports a truncated frame; adaptive
+ * sizing then falls back to the worst case for the rest of the session.
+ */
+void msm_comm_update_bitstream_stats(struct msm_vidc_inst *inst,
+	u32 filled_len, bool overflow)
+{
+	struct msm_vidc_bitstream_stats *stats = &inst->bitstream_stats;
+	u32 mbs;
+
+	if (overflow && !stats->overflow) {
+		stats->overflow = true;
+		msm_comm_handle_bitstream_overflow(inst);
+	}
+
+	if (!filled_len)
+		return;
+
+	mbs = msm_vidc_get_mbs_per_frame(inst);
+	if (mbs != stats->mbs) {
+		stats->mbs = mbs;
+		stats->frames = 0;
+		stats->max_filled_len = 0;
+	}
+	stats->frames++;
+	if (stats->max_filled_len < filled_len)
+		stats->max_filled_len = filled_len;
+}
+
 static void populate_frame_data(struct vidc_frame_data *data,
 		struct msm_vidc_buffer *mbuf, struct msm_vidc_inst *inst)
 {
@@ -5095,12 +5340,100 @@ exit:
 	return rc;
 }
 
+struct msm_vidc_release_batch {
+	struct vidc_buffer_addr_info info;
+	u32 addrs[HAL_MAX_RELEASE_BUFFERS];
+	u32 max_buffers;
+	u32 posted;
+	int rc;
+};
+
+static void msm_comm_release_batch_init(struct msm_vidc_inst *inst,
+		struct msm_vidc_release_batch *batch, bool response_required)
+{
+	memset(batch, 0, sizeof(*batch));
+	batch->info.response_required = response_required;
+	batch->info.device_addrs = batch->addrs;
+	batch->max_buffers = inst->core->resources.batch_release_bufs ?
+		HAL_MAX_RELEASE_BUFFERS : 1;
+}
+
+static void msm_comm_release_batch_flush(struct msm_vidc_inst *inst,
+		struct msm_vidc_release_batch *batch)
+{
+	struct hfi_device *hdev = inst->core->device;
+	struct vidc_buffer_addr_info *info = &batch->info;
+	int rc;
+
+	if (!info->num_buffers)
+		return;
+
+	info->align_device_addr = batch->addrs[0];
+	rc = call_hfi_op(hdev, session_release_buffers,
+			(void *)inst->session, info);
+	if (rc) {
+		s_vpr_e(inst->sid, "Rel %s buf fail:%x, %d, count %d\n",
+			get_buffer_name(info->buffer_type),
+			info->align_device_addr, info->buffer_size,
+			info->num_buffers);
+		batch->rc = rc;
+	} else {
+		batch->posted++;
+	}
+	info->num_buffers = 0;
+}
+
+/*
+ * Buffers of the same type and size share one release packet when the
+ * firmware takes batched releases, otherwise each goes in its own packet.
+ * Either way nothing is waited for until msm_comm_release_batch_wait().
+ */
+static void msm_comm_release_batch_add(struct msm_vidc_inst *inst,
+		struct msm_vidc_release_batch *batch, struct internal_buf *buf)
+{
+	struct vidc_buffer_addr_info *info = &batch->info;
+
+	if (info->num_buffers &&
+		(info->num_buffers == batch->max_buffers ||
+		info->buffer_type != buf->buffer_type ||
+		info->buffer_size != buf->smem.size))
+		msm_comm_release_batch_flush(inst, batch);
+
+	info->buffer_type = buf->buffer_type;
+	info->buffer_size = buf->smem.size;
+	batch->addrs[info->num_buffers++] = buf->smem.device_addr;
+}
+
+/* Called without the buffer list lock, the done handler takes it */
+static int msm_comm_release_batch_wait(struct msm_vidc_inst *inst,
+		struct msm_vidc_release_batch *batch)
+{
+	int rc;
+
+	if (!batch->info.response_required)
+		return batch->rc;
+
+	/* one RELEASE_BUFFER_DONE per packet, acked in order */
+	while (batch->posted) {
+		rc = wait_for_sess_signal_receipt(inst,
+			HAL_SESSION_RELEASE_BUFFER_DONE);
+		if (rc) {
+			s_vpr_e(inst->sid,
+				"%s: wait for signal failed, rc %d\n",
+				__func__, rc);
+			return rc;
+		}
+		batch->posted--;
+	}
+
+	return batch->rc;
+}
+
 int msm_comm_release_dpb_only_buffers(struct msm_vidc_inst *inst,
 	bool force_release)
 {
-	struct msm_smem *handle;
 	struct internal_buf *buf, *dummy;
-	struct vidc_buffer_addr_info buffer_info;
+	struct msm_vidc_release_batch batch;
 	int rc = 0;
 	struct msm_vidc_core *core;
 	struct hfi_device *hdev;
@@ -5128,10 +5461,9 @@ int msm_comm_release_dpb_only_buffers(struct msm_vidc_inst *inst,
 		s_vpr_e(inst->sid, "Invalid device pointer\n");
 		return -EINVAL;
 	}
+	msm_comm_release_batch_init(inst, &batch, false);
 	mutex_lock(&inst->outputbufs.lock);
-	list_for_each_entry_safe(buf, dummy, &inst->outputbufs.list, list) {
-		handle = &buf->smem;
-
+	list_for_each_entry(buf, &inst->outputbufs.list, list) {
 		if ((buf->buffer_ownership == FIRMWARE) && !force_release) {
 			s_vpr_h(inst->sid, "DPB is with f/w. Can't free it\n");
 			/*
@@ -5143,30 +5475,33 @@ int msm_comm_release_dpb_only_buffers(struct msm_vidc_inst *inst,
 			continue;
 		}
 
-		buffer_info.buffer_size = handle->size;
-		buffer_info.buffer_type = buf->buffer_type;
-		buffer_info.num_buffers = 1;
-		buffer_info.align_device_addr = handle->device_addr;
 		if (inst->buffer_mode_set[OUTPUT_PORT] ==
-				HAL_BUFFER_MODE_STATIC) {
-			buffer_info.response_required = false;
-			rc = call_hfi_op(hdev, session_release_buffers,
-				(void *)inst->session, &buffer_info);
-			if (rc) {
-				s_vpr_e(inst->sid,
-					"Rel output buf fail:%x, %d\n",
-					buffer_info.align_device_addr,
-					buffer_info.buffer_size);
-			}
-		}
+				HAL_BUFFER_MODE_STATIC)
+			msm_comm_release_batch_add(inst, &batch, buf);
+	}
+	msm_comm_release_batch_flush(inst, &batch);
+	rc = msm_comm_release_batch_wait(inst, &batch);
+
+	list_for_each_entry_safe(buf, dummy, &inst->outputbufs.list, list) {
+		if ((buf->buffer_ownership == FIRMWARE) && !force_release)
+			continue;
 
 		list_del(&buf->list);
-		msm_comm_smem_free(inst, &buf->smem);
+		if (rc)
+			msm_comm_smem_free(inst, &buf->smem);
+		else
+			msm_comm_internal_smem_free(inst, &buf->smem);
 		kfree(buf);
 	}
 
 	if (inst->dpb_extra_binfo) {
-		msm_comm_smem_free(inst, &inst->dpb_extra_binfo->smem);
+		/* DPBs the f/w still owns point at it, don't recycle it */
+		if (rc || !list_empty(&inst->outputbufs.list))
+			msm_comm_smem_free(inst,
+				&inst->dpb_extra_binfo->smem);
+		else
+			msm_comm_internal_smem_free(inst,
+				&inst->dpb_extra_binfo->smem);
 		kfree(inst->dpb_extra_binfo);
 		inst->dpb_extra_binfo = NULL;
 	}
@@ -5218,9 +5553,8 @@ not_sufficient:
 int msm_comm_release_scratch_buffers(struct msm_vidc_inst *inst,
 					bool check_for_reuse)
 {
-	struct msm_smem *handle;
 	struct internal_buf *buf, *dummy;
-	struct vidc_buffer_addr_info buffer_info;
+	struct msm_vidc_release_batch batch;
 	int rc = 0;
 	struct msm_vidc_core *core;
 	struct hfi_device *hdev;
@@ -5252,37 +5586,27 @@ int msm_comm_release_scratch_buffers(struct msm_vidc_inst *inst,
 					HAL_BUFFER_INTERNAL_SCRATCH_2);
 	}
 
+	msm_comm_release_batch_init(inst, &batch, true);
 	mutex_lock(&inst->scratchbufs.lock);
-	list_for_each_entry_safe(buf, dummy, &inst->scratchbufs.list, list) {
-		handle = &buf->smem;
-		buffer_info.buffer_size = handle->size;
-		buffer_info.buffer_type = buf->buffer_type;
-		buffer_info.num_buffers = 1;
-		buffer_info.align_device_addr = handle->device_addr;
-		buffer_info.response_required = true;
-		rc = call_hfi_op(hdev, session_release_buffers,
-				(void *)inst->session, &buffer_info);
-		if (!rc) {
-			mutex_unlock(&inst->scratchbufs.lock);
-			rc = wait_for_sess_signal_receipt(inst,
-				HAL_SESSION_RELEASE_BUFFER_DONE);
-			if (rc)
-				s_vpr_e(inst->sid,
-					"%s: wait for signal failed, rc %d\n",
-					__func__, rc);
-			mutex_lock(&inst->scratchbufs.lock);
-		} else {
-			s_vpr_e(inst->sid, "Rel scrtch buf fail:%x, %d\n",
-				buffer_info.align_device_addr,
-				buffer_info.buffer_size);
-		}
+	list_for_each_entry(buf, &inst->scratchbufs.list, list)
+		msm_comm_release_batch_add(inst, &batch, buf);
+	msm_comm_release_batch_flush(inst, &batch);
+	mutex_unlock(&inst->scratchbufs.lock);
 
+	rc = msm_comm_release_batch_wait(inst, &batch);
+
+	mutex_lock(&inst->scratchbufs.lock);
+	list_for_each_entry_safe(buf, dummy, &inst->scratchbufs.list, list) {
 		/*If scratch buffers can be reused, do not free the buffers*/
 		if (sufficiency & buf->buffer_type)
 			continue;
 
 		list_del(&buf->list);
-		msm_comm_smem_free(inst, handle);
+		/* f/w may still own buffers it did not return, don't recycle */
+		if (rc)
+			msm_comm_smem_free(inst, &buf->smem);
+		else
+			msm_comm_internal_smem_free(inst, &buf->smem);
 		kfree(buf);
 	}
 
@@ -5332,10 +5656,8 @@ int msm_comm_release_recon_buffers(struct msm_vidc_inst *inst)
 
 int msm_comm_release_persist_buffers(struct msm_vidc_inst *inst)
 {
-	struct msm_smem *handle;
-	struct list_head *ptr, *next;
-	struct internal_buf *buf;
-	struct vidc_buffer_addr_info buffer_info;
+	struct internal_buf *buf, *dummy;
+	struct msm_vidc_release_batch batch;
 	int rc = 0;
 	struct msm_vidc_core *core;
 	struct hfi_device *hdev;
@@ -5355,33 +5677,22 @@ int msm_comm_release_persist_buffers(struct msm_vidc_inst *inst)
 		return -EINVAL;
 	}
 
+	msm_comm_release_batch_init(inst, &batch, true);
 	mutex_lock(&inst->persistbufs.lock);
-	list_for_each_safe(ptr, next, &inst->persistbufs.list) {
-		buf = list_entry(ptr, struct internal_buf, list);
-		handle = &buf->smem;
-		buffer_info.buffer_size = handle->size;
-		buffer_info.buffer_type = buf->buffer_type;
-		buffer_info.num_buffers = 1;
-		buffer_info.align_device_addr = handle->device_addr;
-		buffer_info.response_required = true;
-		rc = call_hfi_op(hdev, session_release_buffers,
-				(void *)inst->session, &buffer_info);
-		if (!rc) {
-			mutex_unlock(&inst->persistbufs.lock);
-			rc = wait_for_sess_signal_receipt(inst,
-				HAL_SESSION_RELEASE_BUFFER_DONE);
-			if (rc)
-				s_vpr_e(inst->sid,
-					"%s: wait for signal failed, rc %d\n",
-					__func__, rc);
-			mutex_lock(&inst->persistbufs.lock);
-		} else {
-			s_vpr_e(inst->sid, "Rel prst buf fail:%x, %d\n",
-				buffer_info.align_device_addr,
-				buffer_info.buffer_size);
-		}
+	list_for_each_entry(buf, &inst->persistbufs.list, list)
+		msm_comm_release_batch_add(inst, &batch, buf);
+	msm_comm_release_batch_flush(inst, &batch);
+	mutex_unlock(&inst->persistbufs.lock);
+
+	rc = msm_comm_release_batch_wait(inst, &batch);
+
+	mutex_lock(&inst->persistbufs.lock);
+	list_for_each_entry_safe(buf, dummy, &inst->persistbufs.list, list) {
 		list_del(&buf->list);
-		msm_comm_smem_free(inst, handle);
+		if (rc)
+			msm_comm_smem_free(inst, &buf->smem);
+		else
+			msm_comm_internal_smem_free(inst, &buf->smem);
 		kfree(buf);
 	}
 	mutex_unlock(&inst->persistbufs.lock);
@@ -5423,33 +5734,120 @@ int msm_comm_set_buffer_count(struct msm_vidc_inst *inst,
 	return rc;
 }
 
-int msm_comm_set_dpb_only_buffers(struct msm_vidc_inst *inst)
+/*
+ * On a resolution change the DPBs already held by the driver are kept when
+ * they are still large enough for the new stream; only missing buffers are
+ * allocated and surplus ones are dropped. Dynamic buffer mode only, as in
+ * static mode the firmware has the old set registered.
+ */
+static bool reuse_dpb_only_buffers(struct msm_vidc_inst *inst)
 {
-	int rc = 0;
-	bool force_release = true;
+	struct hal_buffer_requirements dpb = {0};
+	struct hfi_buffer_size_minimum b;
+	struct internal_buf *buf, *dummy;
+	struct hfi_device *hdev = inst->core->device;
+	struct v4l2_format *f = &inst->fmts[OUTPUT_PORT].v4l2_fmt;
+	u32 smem_flags = SMEM_UNCACHED, extra_size = 0, count = 0;
+	bool reused = false;
+	int rc;
 
-	if (!inst || !inst->core || !inst->core->device) {
-		d_vpr_e("%s: invalid parameters\n", __func__);
-		return -EINVAL;
-	}
+	if (!inst->in_reconfig ||
+		inst->buffer_mode_set[OUTPUT_PORT] != HAL_BUFFER_MODE_DYNAMIC)
+		return false;
 
-	if (get_v4l2_codec(inst) == V4L2_PIX_FMT_VP9)
-		force_release = false;
+	rc = msm_comm_get_dpb_bufreqs(inst, &dpb);
+	if (rc || !dpb.buffer_size)
+		return false;
 
-	if (msm_comm_release_dpb_only_buffers(inst, force_release))
-		s_vpr_e(inst->sid, "Failed to release output buffers\n");
+	if (f->fmt.pix_mp.num_planes > 1)
+		extra_size = f->fmt.pix_mp.plane_fmt[1].sizeimage;
 
-	rc = set_dpb_only_buffers(inst, HAL_BUFFER_OUTPUT);
+	mutex_lock(&inst->outputbufs.lock);
+	if (list_empty(&inst->outputbufs.list))
+		goto exit;
+	list_for_each_entry(buf, &inst->outputbufs.list, list) {
+		if (buf->buffer_ownership != DRIVER || buf->mark_remove ||
+			buf->smem.size < dpb.buffer_size)
+			goto exit;
+	}
+	if (extra_size && (!inst->dpb_extra_binfo ||
+		inst->dpb_extra_binfo->smem.size < extra_size))
+		goto exit;
+
+	b.buffer_type = get_hfi_buffer(HAL_BUFFER_OUTPUT, inst->sid);
+	b.buffer_size = dpb.buffer_size;
+	rc = call_hfi_op(hdev, session_set_property,
+		inst->session, HFI_PROPERTY_PARAM_BUFFER_SIZE_MINIMUM,
+		&b, sizeof(b));
 	if (rc)
-		goto error;
-	return rc;
-error:
-	msm_comm_release_dpb_only_buffers(inst, true);
-	return rc;
-}
+		goto exit;
 
-int msm_comm_set_scratch_buffers(struct msm_vidc_inst *inst)
-{
+	list_for_each_entry_safe(buf, dummy, &inst->outputbufs.list, list) {
+		if (count < dpb.buffer_count_actual) {
+			count++;
+			continue;
+		}
+		list_del(&buf->list);
+		msm_comm_internal_smem_free(inst, &buf->smem);
+		kfree(buf);
+	}
+
+	if (inst->flags & VIDC_SECURE)
+		smem_flags |= SMEM_SECURE;
+
+	for (; count < dpb.buffer_count_actual; count++) {
+		buf = kzalloc(sizeof(*buf), GFP_KERNEL);
+		if (!buf)
+			goto exit;
+		rc = msm_comm_internal_smem_alloc(inst, dpb.buffer_size,
+				smem_flags, HAL_BUFFER_OUTPUT, &buf->smem);
+		if (rc) {
+			kfree(buf);
+			goto exit;
+		}
+		buf->buffer_type = HAL_BUFFER_OUTPUT;
+		buf->buffer_ownership = DRIVER;
+		list_add_tail(&buf->list, &inst->outputbufs.list);
+	}
+	reused = true;
+	s_vpr_h(inst->sid, "%s: reusing dpb: num = %d, size = %d\n",
+		__func__, dpb.buffer_count_actual, dpb.buffer_size);
+
+exit:
+	mutex_unlock(&inst->outputbufs.lock);
+	return reused;
+}
+
+int msm_comm_set_dpb_only_buffers(struct msm_vidc_inst *inst)
+{
+	int rc = 0;
+	bool force_release = true;
+
+	if (!inst || !inst->core || !inst->core->device) {
+		d_vpr_e("%s: invalid parameters\n", __func__);
+		return -EINVAL;
+	}
+
+	if (reuse_dpb_only_buffers(inst))
+		return 0;
+
+	if (get_v4l2_codec(inst) == V4L2_PIX_FMT_VP9)
+		force_release = false;
+
+	if (msm_comm_release_dpb_only_buffers(inst, force_release))
+		s_vpr_e(inst->sid, "Failed to release output buffers\n");
+
+	rc = set_dpb_only_buffers(inst, HAL_BUFFER_OUTPUT);
+	if (rc)
+		goto error;
+	return rc;
+error:
+	msm_comm_release_dpb_only_buffers(inst, true);
+	return rc;
+}
+
+int msm_comm_set_scratch_buffers(struct msm_vidc_inst *inst)
+{
 	int rc = 0;
 
 	if (!inst || !inst->core || !inst->core->device) {
@@ -5598,7 +5996,15 @@ int msm_comm_flush(struct msm_vidc_inst *inst, u32 flags)
 
 	ip_flush = !!(flags & V4L2_CMD_FLUSH_OUTPUT);
 	op_flush = !!(flags & V4L2_CMD_FLUSH_CAPTURE);
-	if (ip_flush && !op_flush) {
+	/*
+	 * Decoder seek only needs the bitstream dropped; output buffers
+	 * already queued stay with firmware and are filled from the new
+	 * position, saving the output flush and re-queue round trip.
+	 * Firmware is not known to support HAL_FLUSH_INPUT on every target,
+	 * so this stays off unless enabled through debugfs input_only_flush.
+	 */
+	if (ip_flush && !op_flush && (!msm_vidc_input_only_flush ||
+		inst->session_type != MSM_VIDC_DECODER)) {
 		s_vpr_e(inst->sid,
 			"Input only flush not supported, making it flush all\n");
 		op_flush = true;
@@ -5633,6 +6039,8 @@ int msm_comm_flush(struct msm_vidc_inst *inst, u32 flags)
 		/* don't flush input buffers if input flush is not requested */
 		if (!ip_flush && mbuf->vvb.vb2_buf.type == INPUT_MPLANE)
 			continue;
+		if (!op_flush && mbuf->vvb.vb2_buf.type == OUTPUT_MPLANE)
+			continue;
 
 		/* flush only deferred or rbr pending buffers */
 		if (!(mbuf->flags & MSM_VIDC_FLAG_DEFERRED ||
@@ -5670,7 +6078,13 @@ int msm_comm_flush(struct msm_vidc_inst *inst, u32 flags)
 	mutex_unlock(&inst->registeredbufs.lock);
 
 	hdev = inst->core->device;
-	if (ip_flush) {
+	inst->flush_stats.start_ns = ktime_get_ns();
+	if (ip_flush && !op_flush) {
+		s_vpr_h(inst->sid, "Send flush on input port to firmware\n");
+		inst->flush_stats.input_only++;
+		rc = call_hfi_op(hdev, session_flush, inst->session,
+			HAL_FLUSH_INPUT);
+	} else if (ip_flush) {
 		s_vpr_h(inst->sid, "Send flush on all ports to firmware\n");
 		rc = call_hfi_op(hdev, session_flush, inst->session,
 			HAL_FLUSH_ALL);
@@ -5857,82 +6271,141 @@ static u32 msm_comm_get_memory_limit(struct msm_vidc_core *core)
 	return memory_limit;
 }
 
-int msm_comm_check_memory_supported(struct msm_vidc_inst *vidc_inst)
+/* footprint of one instance from its formats and buffer requirements */
+static int msm_comm_calc_mem_usage(struct msm_vidc_inst *inst, u64 *usage)
 {
-	struct msm_vidc_core *core;
-	struct msm_vidc_inst *inst;
 	struct msm_vidc_format *fmt;
 	struct v4l2_format *f;
 	struct hal_buffer_requirements *req;
-	struct context_bank_info *cb = NULL;
-	u32 i, dpb_cnt = 0, dpb_size = 0, input_size = 1, rc = 0;
-	u32 inst_mem_size, non_sec_cb_size = 0;
-	u64 total_mem_size = 0, non_sec_mem_size = 0;
-	u32 memory_limit_mbytes;
+	u32 i, input_size;
+	int rc = 0;
 
-	core = vidc_inst->core;
+	memset(usage, 0, sizeof(u64) * MSM_VIDC_MEM_MAX);
+
+	/* input port buffers memory size */
+	fmt = &inst->fmts[INPUT_PORT];
+	f = &fmt->v4l2_fmt;
+	if (is_decode_session(inst))
+		input_size = msm_vidc_calculate_dec_input_frame_size(inst, 0);
+	else
+		input_size = f->fmt.pix_mp.plane_fmt[0].sizeimage;
+	usage[MSM_VIDC_MEM_INPUT] = (u64)input_size * fmt->count_min_host;
+	for (i = 1; i < f->fmt.pix_mp.num_planes; i++)
+		usage[MSM_VIDC_MEM_INPUT] +=
+			(u64)f->fmt.pix_mp.plane_fmt[i].sizeimage *
+			fmt->count_min_host;
+
+	/* output port buffers memory size */
+	fmt = &inst->fmts[OUTPUT_PORT];
+	f = &fmt->v4l2_fmt;
+	for (i = 0; i < f->fmt.pix_mp.num_planes; i++)
+		usage[MSM_VIDC_MEM_OUTPUT] +=
+			(u64)f->fmt.pix_mp.plane_fmt[i].sizeimage *
+			fmt->count_min_host;
+
+	/* dpb buffers memory size */
+	if (msm_comm_get_stream_output_mode(inst) ==
+		HAL_VIDEO_DECODER_SECONDARY) {
+		struct hal_buffer_requirements dpb = {0};
+
+		rc = msm_comm_get_dpb_bufreqs(inst, &dpb);
+		if (rc) {
+			s_vpr_e(inst->sid,
+				"Couldn't retrieve dpb count & size\n");
+			return rc;
+		}
+		usage[MSM_VIDC_MEM_DPB] =
+			(u64)dpb.buffer_count_actual * dpb.buffer_size;
+	}
+
+	/* internal buffers memory size */
+	for (i = 0; i < HAL_BUFFER_MAX; i++) {
+		req = &inst->buff_req.buffer[i];
+		if (is_internal_buffer(req->buffer_type))
+			usage[MSM_VIDC_MEM_INTERNAL] +=
+				(u64)req->buffer_size *
+				req->buffer_count_actual;
+	}
+
+	return 0;
+}
+
+/*
+ * Recompute the footprint of every instance and the core totals. Other
+ * sessions reconfigure and change buffer counts without going through
+ * admission, so their last recorded footprint can't be trusted here.
+ */
+static int msm_comm_update_mem_usage(struct msm_vidc_core *core)
+{
+	struct msm_vidc_inst *inst;
+	u64 usage[MSM_VIDC_MEM_MAX];
+	u64 mem_total = 0, mem_non_secure = 0, total;
+	u32 i;
+	int rc;
+
+	lockdep_assert_held(&core->lock);
 
-	mutex_lock(&core->lock);
 	list_for_each_entry(inst, &core->instances, list) {
-		inst_mem_size = 0;
-		input_size = 1;
-		/* input port buffers memory size */
-		fmt = &inst->fmts[INPUT_PORT];
-		f = &fmt->v4l2_fmt;
-		if (is_decode_session(inst))
-			input_size = msm_vidc_calculate_dec_input_frame_size(inst, 0);
-		else
-			input_size = f->fmt.pix_mp.plane_fmt[0].sizeimage;
-		inst_mem_size += input_size * fmt->count_min_host;
+		rc = msm_comm_calc_mem_usage(inst, usage);
+		if (rc)
+			return rc;
 
-		for (i = 1; i < f->fmt.pix_mp.num_planes; i++)
-			inst_mem_size += f->fmt.pix_mp.plane_fmt[i].sizeimage *
-							fmt->count_min_host;
+		total = 0;
+		for (i = 0; i < MSM_VIDC_MEM_MAX; i++)
+			total += usage[i];
+		memcpy(inst->mem_usage, usage, sizeof(usage));
+		inst->mem_usage_total = total;
+		inst->mem_usage_non_secure =
+			is_secure_session(inst) ? 0 : total;
 
-		/* output port buffers memory size */
-		fmt = &inst->fmts[OUTPUT_PORT];
-		f = &fmt->v4l2_fmt;
-		for (i = 0; i < f->fmt.pix_mp.num_planes; i++)
-			inst_mem_size += f->fmt.pix_mp.plane_fmt[i].sizeimage *
-							fmt->count_min_host;
+		mem_total += inst->mem_usage_total;
+		mem_non_secure += inst->mem_usage_non_secure;
+	}
+	core->mem_total = mem_total;
+	core->mem_non_secure = mem_non_secure;
 
-		/* dpb buffers memory size */
-		if (msm_comm_get_stream_output_mode(inst) ==
-			HAL_VIDEO_DECODER_SECONDARY) {
-			struct hal_buffer_requirements dpb = {0};
+	return 0;
+}
 
-			rc = msm_comm_get_dpb_bufreqs(inst, &dpb);
-			if (rc) {
-				s_vpr_e(inst->sid,
-					"Couldn't retrieve dpb count & size\n");
-				mutex_unlock(&core->lock);
-				return rc;
-			}
-			dpb_cnt = dpb.buffer_count_actual;
-			dpb_size = dpb.buffer_size;
-			inst_mem_size += dpb_cnt * dpb_size;
-		}
+/* called with core->lock held, when inst leaves core->instances */
+void msm_comm_remove_mem_usage(struct msm_vidc_inst *inst)
+{
+	struct msm_vidc_core *core = inst->core;
 
-		/* internal buffers memory size */
-		for (i = 0; i < HAL_BUFFER_MAX; i++) {
-			req = &inst->buff_req.buffer[i];
-			if (is_internal_buffer(req->buffer_type))
-				inst_mem_size += req->buffer_size *
-						req->buffer_count_actual;
-		}
+	core->mem_total -= inst->mem_usage_total;
+	core->mem_non_secure -= inst->mem_usage_non_secure;
+	memset(inst->mem_usage, 0, sizeof(inst->mem_usage));
+	inst->mem_usage_total = 0;
+	inst->mem_usage_non_secure = 0;
+}
+
+int msm_comm_check_memory_supported(struct msm_vidc_inst *vidc_inst)
+{
+	struct msm_vidc_core *core;
+	struct context_bank_info *cb = NULL;
+	u32 non_sec_cb_size = 0;
+	u64 total_mem_size, non_sec_mem_size;
+	int rc;
+
+	core = vidc_inst->core;
 
-		if (!is_secure_session(inst))
-			non_sec_mem_size += inst_mem_size;
-		total_mem_size += inst_mem_size;
+	mutex_lock(&core->lock);
+	rc = msm_comm_update_mem_usage(core);
+	if (rc) {
+		mutex_unlock(&core->lock);
+		return rc;
 	}
+	total_mem_size = core->mem_total;
+	non_sec_mem_size = core->mem_non_secure;
+	/* totalram does not change at runtime, look the limit up once */
+	if (!core->mem_limit_mbytes)
+		core->mem_limit_mbytes = msm_comm_get_memory_limit(core);
 	mutex_unlock(&core->lock);
 
-	memory_limit_mbytes = msm_comm_get_memory_limit(core);
-
-	if ((total_mem_size >> 20) > memory_limit_mbytes) {
+	if ((total_mem_size >> 20) > core->mem_limit_mbytes) {
 		s_vpr_e(vidc_inst->sid,
-			"%s: video mem overshoot - reached %llu MB, max_limit %llu MB\n",
-			__func__, total_mem_size >> 20, memory_limit_mbytes);
+			"%s: video mem overshoot - reached %llu MB, max_limit %u MB\n",
+			__func__, total_mem_size >> 20, core->mem_limit_mbytes);
 		msm_comm_print_mem_usage(core);
 		return -EBUSY;
 	}
@@ -5956,10 +6429,129 @@ int msm_comm_check_memory_supported(struct msm_vidc_inst *vidc_inst)
 	return 0;
 }
 
+/*
+ * Moves inst to non-realtime and tells its client through a control
+ * event on PRIORITY. For a session other than the one being admitted,
+ * the caller holds inst->lock and must not hold core->lock, since this
+ * talks to the firmware.
+ */
+static void msm_comm_demote_session(struct msm_vidc_inst *inst)
+{
+	struct hfi_device *hdev = inst->core->device;
+	struct hfi_enable enable = { .enable = false };
+	struct v4l2_ctrl *ctrl;
+	struct v4l2_event event = {0};
+	int rc;
+
+	ctrl = get_ctrl(inst, V4L2_CID_MPEG_VIDC_VIDEO_PRIORITY);
+	update_ctrl(ctrl, V4L2_MPEG_MSM_VIDC_DISABLE, inst->sid);
+	rc = call_hfi_op(hdev, session_set_property, inst->session,
+		HFI_PROPERTY_CONFIG_REALTIME, &enable, sizeof(enable));
+	if (rc)
+		s_vpr_e(inst->sid, "%s: set property failed\n", __func__);
+
+	event.type = V4L2_EVENT_CTRL;
+	event.id = ctrl->id;
+	event.u.ctrl.changes = V4L2_EVENT_CTRL_CH_VALUE;
+	event.u.ctrl.type = ctrl->type;
+	event.u.ctrl.value = V4L2_MPEG_MSM_VIDC_DISABLE;
+	event.u.ctrl.flags = ctrl->flags;
+	event.u.ctrl.minimum = ctrl->minimum;
+	event.u.ctrl.maximum = ctrl->maximum;
+	event.u.ctrl.step = ctrl->step;
+	event.u.ctrl.default_value = ctrl->default_value;
+	v4l2_event_queue_fh(&inst->event_handler, &event);
+
+	s_vpr_h(inst->sid, "%s: session moved to non-realtime\n", __func__);
+}
+
+/*
+ * Called when admitting inst would exceed the load limits by excess MBs/s.
+ * Instead of refusing a realtime session outright, either admit it as
+ * non-realtime when it has no hard deadline, or move enough realtime
+ * playback sessions to non-realtime to make room for a deadline session.
+ * Returns true if the excess was absorbed.
+ *
+ * Candidates are pinned under core->lock, then locked with trylock:
+ * their lock may be held by a thread waiting on this session, and a
+ * busy session is simply not preempted. Nothing is demoted unless the
+ * locked candidates can absorb the whole excess.
+ */
+static bool msm_comm_admission_degrade(struct msm_vidc_inst *inst, int excess)
+{
+	struct msm_vidc_core *core = inst->core;
+	struct msm_vidc_inst *temp;
+	struct msm_vidc_inst *victims[MAX_SUPPORTED_INSTANCES_24];
+	int loads[MAX_SUPPORTED_INSTANCES_24];
+	int i, count = 0, locked = 0, load, freed = 0;
+	bool absorbed = false;
+
+	if (!msm_vidc_admission_degrade || !is_realtime_session(inst) ||
+		is_thumbnail_session(inst))
+		return false;
+
+	if (!is_deadline_session(inst)) {
+		msm_comm_demote_session(inst);
+		core->admission_demotions++;
+		return true;
+	}
+
+	mutex_lock(&core->lock);
+	list_for_each_entry(temp, &core->instances, list) {
+		if (count == ARRAY_SIZE(victims))
+			break;
+		if (temp == inst || !is_realtime_session(temp) ||
+			is_deadline_session(temp))
+			continue;
+		if (kref_get_unless_zero(&temp->kref))
+			victims[count++] = temp;
+	}
+	mutex_unlock(&core->lock);
+
+	for (i = 0; i < count; i++) {
+		temp = victims[i];
+		if (!mutex_trylock(&temp->lock)) {
+			put_inst(temp);
+			continue;
+		}
+		load = is_realtime_session(temp) ?
+			__msm_comm_get_inst_load_locked(temp,
+				LOAD_ADMISSION_CONTROL) : 0;
+		if (!load) {
+			mutex_unlock(&temp->lock);
+			put_inst(temp);
+			continue;
+		}
+		loads[locked] = load;
+		victims[locked++] = temp;
+		freed += load;
+	}
+
+	if (freed >= excess) {
+		absorbed = true;
+		freed = 0;
+		for (i = 0; i < locked && freed < excess; i++) {
+			s_vpr_h(victims[i]->sid,
+				"%s: preempted by %#x, load %d\n",
+				__func__, inst->sid, loads[i]);
+			msm_comm_demote_session(victims[i]);
+			core->admission_preemptions++;
+			freed += loads[i];
+		}
+	}
+
+	for (i = 0; i < locked; i++) {
+		mutex_unlock(&victims[i]->lock);
+		put_inst(victims[i]);
+	}
+
+	return absorbed;
+}
+
 static int msm_vidc_check_mbps_supported(struct msm_vidc_inst *inst)
 {
 	int max_video_load = 0, max_image_load = 0;
-	int video_load = 0, image_load = 0;
+	int video_load = 0, image_load = 0, excess;
 	enum load_calc_quirks quirks = LOAD_ADMISSION_CONTROL;
 
 	if (inst->state == MSM_VIDC_OPEN_DONE) {
@@ -5976,6 +6568,12 @@ static int msm_vidc_check_mbps_supported(struct msm_vidc_inst *inst)
 		max_video_load = inst->core->resources.max_load;
 		max_image_load = inst->core->resources.max_image_load;
 
+		excess = max(video_load - max_video_load,
+			video_load + image_load -
+			(max_video_load + max_image_load));
+		if (excess > 0 && msm_comm_admission_degrade(inst, excess))
+			return 0;
+
 		if (video_load > max_video_load) {
 			s_vpr_e(inst->sid,
 				"H/W is overloaded. needed: %d max: %d\n",
@@ -6321,6 +6919,7 @@ int msm_comm_kill_session(struct msm_vidc_inst *inst)
 		}
 	}
 
+	inst->release_res_posted = false;
 	change_inst_state(inst, MSM_VIDC_CLOSE_DONE);
 	msm_comm_session_clean(inst);
 
@@ -6355,6 +6954,206 @@ void msm_comm_smem_free(struct msm_vidc_inst *inst, struct msm_smem *mem)
 	msm_smem_free(mem, inst->sid);
 }
 
+/*
+ * Internal (scratch and DPB) allocations are recycled through a core wide
+ * pool so that a new session does not pay for the ion allocation and SMMU
+ * mapping again. Entries are keyed by session type, buffer type and
+ * allocation flags, which together select the heap and the context bank the
+ * buffer is mapped into, and matched on best fit by size.
+ *
+ * A recycled buffer still holds the previous session's data, so it is
+ * cleared before reuse. Persist buffers carry firmware state and are not
+ * pooled.
+ *
+ * Secure buffers are not pooled either. They cannot be cleared from the
+ * CPU and the firmware has no command to clear them, so a recycled one
+ * would hand a protected session's frames to the next secure session.
+ * They also come out of the secure heap, which the shrinker cannot see
+ * under pressure: idle pooled buffers there would fail secure allocations
+ * of other clients rather than be reclaimed.
+ */
+static void msm_comm_internal_pool_evict(struct msm_vidc_core *core,
+		struct msm_vidc_pool_buf *pbuf)
+{
+	list_del(&pbuf->list);
+	core->internal_pool_size -= pbuf->smem.size;
+	msm_smem_free(&pbuf->smem, DEFAULT_SID);
+	kfree(pbuf);
+}
+
+static bool msm_comm_internal_poolable(enum hal_buffer buffer_type,
+		u32 flags)
+{
+	return buffer_type != HAL_BUFFER_INTERNAL_PERSIST &&
+		buffer_type != HAL_BUFFER_INTERNAL_PERSIST_1 &&
+		!(flags & SMEM_SECURE);
+}
+
+int msm_comm_internal_smem_alloc(struct msm_vidc_inst *inst,
+		size_t size, u32 flags, enum hal_buffer buffer_type,
+		struct msm_smem *smem)
+{
+	struct msm_vidc_core *core;
+	struct msm_vidc_pool_buf *pbuf, *match = NULL;
+	u32 want;
+
+	if (!inst || !inst->core || !smem) {
+		d_vpr_e("%s: invalid params\n", __func__);
+		return -EINVAL;
+	}
+	core = inst->core;
+	if (!msm_comm_internal_poolable(buffer_type, flags))
+		goto alloc;
+	want = ALIGN(size, SZ_4K);
+
+	mutex_lock(&core->internal_pool.lock);
+	list_for_each_entry(pbuf, &core->internal_pool.list, list) {
+		if (pbuf->session_type != inst->session_type ||
+			pbuf->smem.buffer_type != buffer_type ||
+			pbuf->smem.flags != flags)
+			continue;
+		/* don't hand out more than 1/8th above the request */
+		if (pbuf->smem.size < want ||
+			pbuf->smem.size - want > want >> 3)
+			continue;
+		if (!match || pbuf->smem.size < match->smem.size)
+			match = pbuf;
+	}
+	if (match) {
+		list_del(&match->list);
+		core->internal_pool_size -= match->smem.size;
+		core->internal_pool_hits++;
+	} else {
+		core->internal_pool_misses++;
+	}
+	mutex_unlock(&core->internal_pool.lock);
+
+	if (!match)
+		goto alloc;
+
+	*smem = match->smem;
+	kfree(match);
+	if (msm_smem_clear(smem, inst->sid)) {
+		s_vpr_e(inst->sid, "%s: clear failed, reallocating\n",
+			__func__);
+		msm_smem_free(smem, inst->sid);
+		memset(smem, 0, sizeof(*smem));
+		goto alloc;
+	}
+	s_vpr_h(inst->sid, "%s: reused %#x size %u type %#x\n",
+		__func__, smem->device_addr, smem->size, buffer_type);
+	return 0;
+
+alloc:
+	return msm_comm_smem_alloc(inst, size, 1, flags,
+			buffer_type, 0, smem);
+}
+
+void msm_comm_internal_smem_free(struct msm_vidc_inst *inst,
+		struct msm_smem *smem)
+{
+	struct msm_vidc_core *core;
+	struct msm_vidc_pool_buf *pbuf, *old, *next;
+	u64 max_size = (u64)msm_vidc_internal_pool_max_kb * SZ_1K;
+
+	if (!inst || !inst->core || !smem) {
+		d_vpr_e("%s: invalid params\n", __func__);
+		return;
+	}
+	core = inst->core;
+
+	if (!smem->dma_buf || smem->kvaddr || smem->size > max_size ||
+		!msm_comm_internal_poolable(smem->buffer_type, smem->flags))
+		goto free_smem;
+
+	pbuf = kzalloc(sizeof(*pbuf), GFP_KERNEL);
+	if (!pbuf)
+		goto free_smem;
+
+	pbuf->session_type = inst->session_type;
+	pbuf->smem = *smem;
+
+	mutex_lock(&core->internal_pool.lock);
+	/* oldest entries are at the head, evict them first */
+	list_for_each_entry_safe(old, next, &core->internal_pool.list, list) {
+		if (core->internal_pool_size + smem->size <= max_size)
+			break;
+		msm_comm_internal_pool_evict(core, old);
+	}
+	list_add_tail(&pbuf->list, &core->internal_pool.list);
+	core->internal_pool_size += smem->size;
+	mutex_unlock(&core->internal_pool.lock);
+	s_vpr_h(inst->sid, "%s: pooled %#x size %u type %#x\n",
+		__func__, smem->device_addr, smem->size, smem->buffer_type);
+	memset(smem, 0, sizeof(*smem));
+	return;
+
+free_smem:
+	msm_comm_smem_free(inst, smem);
+}
+
+static unsigned long msm_comm_internal_pool_count(struct shrinker *shrinker,
+		struct shrink_control *sc)
+{
+	struct msm_vidc_core *core = container_of(shrinker,
+		struct msm_vidc_core, internal_pool_shrinker);
+
+	return core->internal_pool_size >> PAGE_SHIFT;
+}
+
+static unsigned long msm_comm_internal_pool_scan(struct shrinker *shrinker,
+		struct shrink_control *sc)
+{
+	struct msm_vidc_core *core = container_of(shrinker,
+		struct msm_vidc_core, internal_pool_shrinker);
+	struct msm_vidc_pool_buf *pbuf, *next;
+	unsigned long freed = 0;
+
+	if (!mutex_trylock(&core->internal_pool.lock))
+		return SHRINK_STOP;
+
+	list_for_each_entry_safe(pbuf, next, &core->internal_pool.list, list) {
+		if (freed >= sc->nr_to_scan)
+			break;
+		freed += pbuf->smem.size >> PAGE_SHIFT;
+		msm_comm_internal_pool_evict(core, pbuf);
+	}
+	mutex_unlock(&core->internal_pool.lock);
+
+	return freed;
+}
+
+int msm_comm_internal_pool_init(struct msm_vidc_core *core)
+{
+	INIT_LIST_HEAD(&core->internal_pool.list);
+	mutex_init(&core->internal_pool.lock);
+	core->internal_pool_size = 0;
+
+	core->internal_pool_shrinker.count_objects =
+		msm_comm_internal_pool_count;
+	core->internal_pool_shrinker.scan_objects =
+		msm_comm_internal_pool_scan;
+	core->internal_pool_shrinker.seeks = DEFAULT_SEEKS;
+	return register_shrinker(&core->internal_pool_shrinker);
+}
+
+void msm_comm_internal_pool_drain(struct msm_vidc_core *core)
+{
+	struct msm_vidc_pool_buf *pbuf, *next;
+
+	mutex_lock(&core->internal_pool.lock);
+	list_for_each_entry_safe(pbuf, next, &core->internal_pool.list, list)
+		msm_comm_internal_pool_evict(core, pbuf);
+	mutex_unlock(&core->internal_pool.lock);
+}
+
+void msm_comm_internal_pool_deinit(struct msm_vidc_core *core)
+{
+	unregister_shrinker(&core->internal_pool_shrinker);
+	msm_comm_internal_pool_drain(core);
+	mutex_destroy(&core->internal_pool.lock);
+}
+
 void msm_vidc_fw_unload_handler(struct work_struct *work)
 {
 	struct msm_vidc_core *core = NULL;
@@ -6384,8 +7183,6 @@ void msm_vidc_fw_unload_handler(struct work_struct *work)
 			}
 		}
 		core->state = VIDC_CORE_UNINIT;
-		kfree(core->capabilities);
-		core->capabilities = NULL;
 	}
 	mutex_unlock(&core->lock);
 }
@@ -6803,6 +7600,46 @@ int msm_comm_flush_vidc_buffer(struct msm_vidc_inst *inst,
 	return 0;
 }
 
+/*
+ * Range of an encoder output buffer to invalidate before handing it to
+ * the firmware. A prepared buffer stays mapped across dqbuf/qbuf and its
+ * client must not write to it with the CPU, so only the part handed out
+ * by its last dqbuf can hold lines the client read in; the rest was
+ * invalidated on an earlier qbuf. Anything else, including a prepared
+ * buffer that has not been through dqbuf yet, is invalidated in full.
+ * Called with registeredbufs.lock held.
+ */
+static void msm_comm_bitstream_cache_range(struct msm_vidc_inst *inst,
+		struct msm_vidc_buffer *mbuf, unsigned long *offset,
+		unsigned long *size)
+{
+	struct msm_smem *smem = &mbuf->smem[0];
+
+	lockdep_assert_held(&inst->registeredbufs.lock);
+	if (!(smem->flags & SMEM_PREPARED) || !smem->prepared ||
+		!smem->prepared->client_len_valid)
+		return;
+
+	*offset = 0;
+	*size = smem->prepared->client_len;
+}
+
+/* Records the part of a prepared encoder output buffer given to the client */
+static void msm_comm_bitstream_record_range(struct msm_vidc_inst *inst,
+		struct msm_vidc_buffer *mbuf, unsigned long size)
+{
+	struct msm_smem *smem = &mbuf->smem[0];
+
+	if (!(smem->flags & SMEM_PREPARED) || !smem->prepared)
+		return;
+
+	mutex_lock(&inst->registeredbufs.lock);
+	smem->prepared->client_len = min_t(unsigned long, size,
+		mbuf->vvb.vb2_buf.planes[0].length);
+	smem->prepared->client_len_valid = true;
+	mutex_unlock(&inst->registeredbufs.lock);
+}
+
 int msm_comm_qbuf_cache_operations(struct msm_vidc_inst *inst,
 		struct msm_vidc_buffer *mbuf)
 {
@@ -6847,11 +7684,20 @@ int msm_comm_qbuf_cache_operations(struct msm_vidc_inst *inst,
 					cache_op = SMEM_CACHE_CLEAN_INVALIDATE;
 				}
 			} else if (vb->type == OUTPUT_MPLANE) {
-				if (!i && inst->max_filled_len)
-					size = inst->max_filled_len;
+				if (!i) /* bitstream */
+					msm_comm_bitstream_cache_range(inst,
+						mbuf, &offset, &size);
 			}
 		}
 
+		if (offset >= vb->planes[i].length)
+			skip = true;
+		else
+			size = min_t(unsigned long, size,
+				vb->planes[i].length - offset);
+		if (!size)
+			skip = true;
+
 		if (!skip) {
 			rc = msm_smem_cache_operations(mbuf->smem[i].dma_buf,
 					cache_op, offset, size, inst->sid);
@@ -6910,10 +7756,20 @@ int msm_comm_dqbuf_cache_operations(struct msm_vidc_inst *inst,
 					offset = 0;
 					size = vb->planes[i].bytesused +
 						vb->planes[i].data_offset;
+					msm_comm_bitstream_record_range(inst,
+						mbuf, size);
 				}
 			}
 		}
 
+		if (offset >= vb->planes[i].length)
+			skip = true;
+		else
+			size = min_t(unsigned long, size,
+				vb->planes[i].length - offset);
+		if (!size)
+			skip = true;
+
 		if (!skip) {
 			rc = msm_smem_cache_operations(mbuf->smem[i].dma_buf,
 					cache_op, offset, size, inst->sid);
@@ -6926,6 +7782,126 @@ int msm_comm_dqbuf_cache_operations(struct msm_vidc_inst *inst,
 	return rc;
 }
 
+/*
+ * Imports and maps one plane of buffer @index. There is at most one
+ * prepared entry per type, index and plane, so a client cannot pin more
+ * buffers than the queue holds; preparing an index again replaces the
+ * entry. Buffers still queued keep their own reference to the old one.
+ */
+int msm_comm_prepare_buffer(struct msm_vidc_inst *inst, u32 type,
+		u32 index, u32 plane, int fd, u32 size)
+{
+	int rc = 0;
+	struct msm_vidc_prepared_buf *pbuf, *temp, *old = NULL;
+
+	if (!inst) {
+		d_vpr_e("%s: invalid params\n", __func__);
+		return -EINVAL;
+	}
+
+	pbuf = kzalloc(sizeof(*pbuf), GFP_KERNEL);
+	if (!pbuf)
+		return -ENOMEM;
+
+	kref_init(&pbuf->kref);
+	pbuf->inst = inst;
+	pbuf->type = type;
+	pbuf->index = index;
+	pbuf->plane = plane;
+	pbuf->smem.fd = fd;
+	pbuf->smem.size = size;
+	pbuf->smem.buffer_type = get_hal_buffer_type(type, plane);
+	rc = inst->smem_ops->smem_map_dma_buf(inst, &pbuf->smem);
+	if (rc) {
+		s_vpr_e(inst->sid, "%s: map failed, fd %d\n", __func__, fd);
+		kfree(pbuf);
+		return rc;
+	}
+
+	mutex_lock(&inst->prepared_bufs.lock);
+	list_for_each_entry(temp, &inst->prepared_bufs.list, list) {
+		if (temp->type == type && temp->index == index &&
+			temp->plane == plane) {
+			old = temp;
+			break;
+		}
+	}
+	if (old && old->smem.dma_buf == pbuf->smem.dma_buf) {
+		mutex_unlock(&inst->prepared_bufs.lock);
+		msm_smem_put_prepared(pbuf);
+		return 0;
+	}
+	if (old) {
+		list_del(&old->list);
+		msm_smem_put_prepared(old);
+	}
+	list_add_tail(&pbuf->list, &inst->prepared_bufs.list);
+	mutex_unlock(&inst->prepared_bufs.lock);
+
+	s_vpr_h(inst->sid,
+		"prepared: type %d index %d plane %d fd %d daddr %#x\n",
+		type, index, plane, fd, pbuf->smem.device_addr);
+
+	return 0;
+}
+
+/*
+ * Drops the prepared list's reference on the buffers of @type, or on all
+ * of them if @type is 0. Mappings still borrowed by registered buffers
+ * are released once those buffers are unmapped.
+ */
+void msm_comm_release_prepared_buffers(struct msm_vidc_inst *inst, u32 type)
+{
+	struct msm_vidc_prepared_buf *pbuf, *next;
+
+	if (!inst) {
+		d_vpr_e("%s: invalid params\n", __func__);
+		return;
+	}
+
+	mutex_lock(&inst->prepared_bufs.lock);
+	list_for_each_entry_safe(pbuf, next, &inst->prepared_bufs.list, list) {
+		if (type && pbuf->type != type)
+			continue;
+		list_del(&pbuf->list);
+		msm_smem_put_prepared(pbuf);
+	}
+	mutex_unlock(&inst->prepared_bufs.lock);
+}
+
+/*
+ * Maps a plane of a client buffer onto @dbuf, consuming the reference
+ * taken when the fd was resolved. The prepared buffer's mapping is used
+ * when the client pre-registered it, avoiding the iommu map on the qbuf
+ * path.
+ */
+static int msm_comm_map_vidc_plane(struct msm_vidc_inst *inst,
+		struct msm_smem *smem, struct dma_buf *dbuf)
+{
+	struct msm_vidc_prepared_buf *pbuf;
+	int rc = -ENOENT;
+
+	if (smem->refcount) {
+		smem->refcount++;
+		msm_smem_put_dma_buf(dbuf, inst->sid);
+		return 0;
+	}
+
+	mutex_lock(&inst->prepared_bufs.lock);
+	list_for_each_entry(pbuf, &inst->prepared_bufs.list, list) {
+		if (pbuf->smem.dma_buf == dbuf &&
+			pbuf->smem.buffer_type == smem->buffer_type) {
+			rc = msm_smem_map_prepared(inst, smem, pbuf);
+			break;
+		}
+	}
+	mutex_unlock(&inst->prepared_bufs.lock);
+	if (rc != -ENOENT)
+		return rc;
+
+	return msm_smem_map_dma_buf_ref(inst, smem, dbuf);
+}
+
 struct msm_vidc_buffer *msm_comm_get_vidc_buffer(struct msm_vidc_inst *inst,
 		struct vb2_buffer *vb2)
 {
@@ -6947,13 +7923,18 @@ struct msm_vidc_buffer *msm_comm_get_vidc_buffer(struct msm_vidc_inst *inst,
 		/*
 		 * always compare dma_buf addresses which is guaranteed
 		 * to be same across the processes (duplicate fds).
+		 * The reference is kept and handed over to the map below,
+		 * so each plane resolves its fd only once.
 		 */
 		dma_planes[i] = (unsigned long)msm_smem_get_dma_buf(
 				vb2->planes[i].m.fd, inst->sid);
-		if (!dma_planes[i])
+		if (!dma_planes[i]) {
+			while (i--)
+				msm_smem_put_dma_buf(
+					(struct dma_buf *)dma_planes[i],
+					inst->sid);
 			return NULL;
-		msm_smem_put_dma_buf((struct dma_buf *)dma_planes[i],
-			inst->sid);
+		}
 	}
 
 	mutex_lock(&inst->registeredbufs.lock);
@@ -6986,8 +7967,12 @@ struct msm_vidc_buffer *msm_comm_get_vidc_buffer(struct msm_vidc_inst *inst,
 		if (!mbuf) {
 			s_vpr_e(inst->sid, "%s: alloc msm_vidc_buffer failed\n",
 				__func__);
-			rc = -ENOMEM;
-			goto exit;
+			mutex_unlock(&inst->registeredbufs.lock);
+			for (i = 0; i < vb2->num_planes; i++)
+				msm_smem_put_dma_buf(
+					(struct dma_buf *)dma_planes[i],
+					inst->sid);
+			return ERR_PTR(-ENOMEM);
 		}
 		kref_init(&mbuf->kref);
 	}
@@ -7004,17 +7989,18 @@ struct msm_vidc_buffer *msm_comm_get_vidc_buffer(struct msm_vidc_inst *inst,
 		mbuf->smem[i].fd = vb->planes[i].m.fd;
 		mbuf->smem[i].offset = vb->planes[i].data_offset;
 		mbuf->smem[i].size = vb->planes[i].length;
-		rc = inst->smem_ops->smem_map_dma_buf(inst, &mbuf->smem[i]);
+		rc = msm_comm_map_vidc_plane(inst, &mbuf->smem[i],
+			(struct dma_buf *)dma_planes[i]);
 		if (rc) {
 			s_vpr_e(inst->sid, "%s: map failed.\n", __func__);
+			while (++i < vb->num_planes)
+				msm_smem_put_dma_buf(
+					(struct dma_buf *)dma_planes[i],
+					inst->sid);
 			goto exit;
 		}
 		/* increase refcount as we get both fbd and rbr */
-		rc = inst->smem_ops->smem_map_dma_buf(inst, &mbuf->smem[i]);
-		if (rc) {
-			s_vpr_e(inst->sid, "%s: map failed..\n", __func__);
-			goto exit;
-		}
+		mbuf->smem[i].refcount++;
 	}
 	/* dma cache operations need to be performed after dma_map */
 	msm_comm_qbuf_cache_operations(inst, mbuf);
@@ -64,14 +64,20 @@ static inline bool is_cvp_supported(struct msm_vidc_inst *inst)
 	return inst->core && !inst->core->resources.no_cvp;
 }
 
+/* inst->ctrls[] follows the id sorted control template */
 static inline struct v4l2_ctrl *get_ctrl(struct msm_vidc_inst *inst,
 	u32 id)
 {
-	int i;
-
-	for (i = 0; i < inst->num_ctrls; i++) {
-		if (inst->ctrls[i]->id == id)
-			return inst->ctrls[i];
+	u32 lo = 0, hi = inst->num_ctrls, mid;
+
+	while (lo < hi) {
+		mid = lo + ((hi - lo) >> 1);
+		if (inst->ctrls[mid]->id == id)
+			return inst->ctrls[mid];
+		if (inst->ctrls[mid]->id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 	s_vpr_e(inst->sid, "%s: control id (%#x) not found\n", __func__, id);
 	MSM_VIDC_ERROR(true);
@@ -82,6 +88,7 @@ static inline void update_ctrl(struct v4l2_ctrl *ctrl, s32 val, u32 sid)
 {
 	switch (ctrl->type) {
 	case V4L2_CTRL_TYPE_INTEGER:
+	case V4L2_CTRL_TYPE_BOOLEAN:
 		*ctrl->p_cur.p_s32 = val;
 		memcpy(ctrl->p_new.p, ctrl->p_cur.p,
 			ctrl->elems * ctrl->elem_size);
@@ -187,6 +194,16 @@ static inline bool is_encode_session(struct msm_vidc_inst *inst)
 	return inst->session_type == MSM_VIDC_ENCODER;
 }
 
+/*
+ * Realtime sessions fed by a live source (encoders, low latency decode)
+ * must meet every frame deadline; realtime playback can buffer ahead and
+ * is the first to be degraded when the core is overloaded.
+ */
+static inline bool is_deadline_session(struct msm_vidc_inst *inst)
+{
+	return is_encode_session(inst) || is_low_latency_hint(inst);
+}
+
 static inline bool is_encode_batching(struct msm_vidc_inst *inst)
 {
 	struct v4l2_ctrl *ctrl;
@@ -331,11 +348,21 @@ int msm_comm_smem_alloc(struct msm_vidc_inst *inst, size_t size, u32 align,
 		u32 flags, enum hal_buffer buffer_type, int map_kernel,
 		struct msm_smem *smem);
 void msm_comm_smem_free(struct msm_vidc_inst *inst, struct msm_smem *smem);
+int msm_comm_internal_smem_alloc(struct msm_vidc_inst *inst, size_t size,
+		u32 flags, enum hal_buffer buffer_type, struct msm_smem *smem);
+void msm_comm_internal_smem_free(struct msm_vidc_inst *inst,
+		struct msm_smem *smem);
+void msm_comm_remove_mem_usage(struct msm_vidc_inst *inst);
+int msm_comm_internal_pool_init(struct msm_vidc_core *core);
+void msm_comm_internal_pool_drain(struct msm_vidc_core *core);
+void msm_comm_internal_pool_deinit(struct msm_vidc_core *core);
 int msm_comm_smem_cache_operations(struct msm_vidc_inst *inst,
 		struct msm_smem *mem, enum smem_cache_ops cache_ops);
 enum hal_video_codec get_hal_codec(int fourcc, u32 sid);
 enum hal_domain get_hal_domain(int session_type, u32 sid);
 int msm_comm_check_core_init(struct msm_vidc_core *core, u32 sid);
+int __msm_comm_get_inst_load_locked(struct msm_vidc_inst *inst,
+		enum load_calc_quirks quirks);
 int msm_comm_get_inst_load(struct msm_vidc_inst *inst,
 			enum load_calc_quirks quirks);
 int msm_comm_get_inst_load_per_core(struct msm_vidc_inst *inst,
@@ -353,6 +380,7 @@ int msm_comm_ctrl_init(struct msm_vidc_inst *inst,
 		struct msm_vidc_ctrl *drv_ctrls, u32 num_ctrls,
 		const struct v4l2_ctrl_ops *ctrl_ops);
 int msm_comm_ctrl_deinit(struct msm_vidc_inst *inst);
+void msm_comm_ctrl_templates_free(struct msm_vidc_core *core);
 void msm_comm_cleanup_internal_buffers(struct msm_vidc_inst *inst);
 bool msm_comm_turbo_session(struct msm_vidc_inst *inst);
 void msm_comm_print_inst_info(struct msm_vidc_inst *inst);
@@ -371,6 +399,11 @@ struct msm_vidc_buffer *msm_comm_get_buffer_using_device_planes(
 		struct msm_vidc_inst *inst, u32 type, u32 *planes);
 struct msm_vidc_buffer *msm_comm_get_vidc_buffer(struct msm_vidc_inst *inst,
 		struct vb2_buffer *vb2);
+int msm_comm_prepare_buffer(struct msm_vidc_inst *inst, u32 type,
+		u32 index, u32 plane, int fd, u32 size);
+void msm_comm_release_prepared_buffers(struct msm_vidc_inst *inst, u32 type);
+void msm_comm_update_bitstream_stats(struct msm_vidc_inst *inst,
+	u32 filled_len, bool overflow);
 void msm_comm_put_vidc_buffer(struct msm_vidc_inst *inst,
 		struct msm_vidc_buffer *mbuf);
 void handle_release_buffer_reference(struct msm_vidc_inst *inst,
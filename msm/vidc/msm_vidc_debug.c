@@ -24,6 +24,17 @@ bool msm_vidc_syscache_disable = !true;
 bool msm_vidc_cvp_usage = true;
 int msm_vidc_err_recovery_disable = !1;
 int msm_vidc_vpp_delay;
+bool msm_vidc_pc_prediction = true;
+bool msm_vidc_pc_spec_resume = true;
+bool msm_vidc_bus_restore_vote = !true;
+int msm_vidc_fw_retain_max_ms = 10000;
+int msm_vidc_internal_pool_max_kb = 32768;
+bool msm_vidc_input_only_flush;
+bool msm_vidc_admission_degrade = true;
+int msm_vidc_msgq_poll_us = 2000;
+int msm_vidc_msgq_poll_min = 4;
+bool msm_vidc_cb_demux = true;
+bool msm_vidc_adaptive_bitstream;
 
 #define MAX_DBG_BUF_SIZE 4096
 
@@ -76,6 +87,24 @@ static ssize_t core_info_read(struct file *file, char __user *buf,
 	cur += write_str(cur, end - cur, "CORE %d: %pK\n", core->id, core);
 	cur += write_str(cur, end - cur, "===============================\n");
 	cur += write_str(cur, end - cur, "Core state: %d\n", core->state);
+	cur += write_str(cur, end - cur,
+		"FW opens warm: %u cold: %u reopen gap: %u ms\n",
+		core->fw_warm_opens, core->fw_cold_opens,
+		core->fw_reopen_gap_ms);
+	cur += write_str(cur, end - cur,
+		"Internal pool: %llu KB hits: %u misses: %u\n",
+		core->internal_pool_size >> 10, core->internal_pool_hits,
+		core->internal_pool_misses);
+	cur += write_str(cur, end - cur,
+		"Buffer size cache hits: %u misses: %u\n",
+		core->buf_size_cache.hits, core->buf_size_cache.misses);
+	cur += write_str(cur, end - cur,
+		"Video memory: %llu KB (non-secure %llu KB) limit %u MB\n",
+		core->mem_total >> 10, core->mem_non_secure >> 10,
+		core->mem_limit_mbytes);
+	cur += write_str(cur, end - cur,
+		"Admission demotions: %u preemptions: %u\n",
+		core->admission_demotions, core->admission_preemptions);
 	rc = call_hfi_op(hdev, get_fw_info, hdev->hfi_device_data, &fw_info);
 	if (rc) {
 		d_vpr_e("Failed to read FW info\n");
@@ -112,6 +141,108 @@ static const struct file_operations core_info_fops = {
 	.read = core_info_read,
 };
 
+static ssize_t pm_stats_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct msm_vidc_core *core = file->private_data;
+	struct hfi_device *hdev;
+	struct hal_pm_stats stats = {0};
+	static const char * const hist_names[HAL_PM_RESUME_HIST_BUCKETS] = {
+		"<1ms", "1-2ms", "2-5ms", "5-10ms", "10-20ms", ">=20ms",
+	};
+	static const char * const lock_names[HAL_LOCK_MAX] = {
+		"device", "response", "resource",
+	};
+	struct hal_lock_stats *lock;
+	char *dbuf, *cur, *end;
+	int i = 0, rc = 0;
+	ssize_t len = 0;
+
+	if (!core || !core->device) {
+		d_vpr_e("%s: invalid params %pK\n", __func__, core);
+		return 0;
+	}
+
+	hdev = core->device;
+	rc = call_hfi_op(hdev, get_pm_stats, hdev->hfi_device_data, &stats);
+	if (rc) {
+		d_vpr_e("Failed to read PM stats\n");
+		return rc;
+	}
+
+	dbuf = kzalloc(MAX_DBG_BUF_SIZE, GFP_KERNEL);
+	if (!dbuf) {
+		d_vpr_e("%s: Allocation failed!\n", __func__);
+		return -ENOMEM;
+	}
+	cur = dbuf;
+	end = cur + MAX_DBG_BUF_SIZE;
+
+	cur += write_str(cur, end - cur, "prediction: %s\n",
+		msm_vidc_pc_prediction ? "on" : "off");
+	cur += write_str(cur, end - cur, "collapses: %u\n", stats.collapses);
+	cur += write_str(cur, end - cur, "early collapses: %u\n",
+		stats.early_collapses);
+	cur += write_str(cur, end - cur, "mispredictions (early): %u\n",
+		stats.mispredict_early);
+	cur += write_str(cur, end - cur, "mispredictions (held): %u\n",
+		stats.mispredict_held);
+	cur += write_str(cur, end - cur, "resumes: %u\n", stats.resumes);
+	cur += write_str(cur, end - cur, "resume latency avg: %u us\n",
+		stats.resume_avg_us);
+	cur += write_str(cur, end - cur, "resume latency max: %u us\n",
+		stats.resume_max_us);
+	for (i = 0; i < HAL_PM_RESUME_HIST_BUCKETS; i++)
+		cur += write_str(cur, end - cur, "  %-8s: %u\n",
+			hist_names[i], stats.resume_hist[i]);
+	cur += write_str(cur, end - cur, "speculative resume: %s\n",
+		msm_vidc_pc_spec_resume ? "on" : "off");
+	cur += write_str(cur, end - cur, "speculative resumes: %u\n",
+		stats.spec_resumes);
+	cur += write_str(cur, end - cur, "  hits: %u\n", stats.spec_hits);
+	cur += write_str(cur, end - cur, "  late: %u\n", stats.spec_late);
+	cur += write_str(cur, end - cur, "  wasted: %u\n", stats.spec_wasted);
+	cur += write_str(cur, end - cur, "bus vote restore: %s\n",
+		msm_vidc_bus_restore_vote ? "on" : "off");
+	cur += write_str(cur, end - cur, "bus vote restores: %u\n",
+		stats.bus_restores);
+	cur += write_str(cur, end - cur, "  too low: %u\n",
+		stats.bus_restore_low);
+	cur += write_str(cur, end - cur, "msg queue batches: %u\n",
+		stats.msgq_batches);
+	cur += write_str(cur, end - cur, "  packets: %u\n",
+		stats.msgq_packets);
+	cur += write_str(cur, end - cur, "  copied: %u\n",
+		stats.msgq_copies);
+	cur += write_str(cur, end - cur, "interrupts: %u frames: %u\n",
+		stats.interrupts, stats.frames);
+	cur += write_str(cur, end - cur, "  per 100 frames: %u\n",
+		stats.frames ? (u32)div_u64((u64)stats.interrupts * 100,
+			stats.frames) : 0);
+	cur += write_str(cur, end - cur, "msg queue poll rounds: %u\n",
+		stats.poll_rounds);
+	cur += write_str(cur, end - cur, "  packets: %u\n",
+		stats.poll_packets);
+	for (i = 0; i < HAL_LOCK_MAX; i++) {
+		lock = &stats.locks[i];
+		cur += write_str(cur, end - cur,
+			"%s lock: acquired %u contended %u wait %llu us max %u us\n",
+			lock_names[i], lock->acquired, lock->contended,
+			lock->wait_us, lock->max_wait_us);
+	}
+
+	len = simple_read_from_buffer(buf, count, ppos,
+			dbuf, cur - dbuf);
+
+	kfree(dbuf);
+	return len;
+}
+
+static const struct file_operations pm_stats_fops = {
+	.open = simple_open,
+	.read = pm_stats_read,
+};
+
 static ssize_t trigger_ssr_write(struct file *filp, const char __user *buf,
 		size_t count, loff_t *ppos)
 {
@@ -243,7 +374,24 @@ struct dentry *msm_vidc_debugfs_init_drv(void)
 			&msm_vidc_lossless_encode) &&
 	__debugfs_create(u32, "disable_err_recovery",
 			&msm_vidc_err_recovery_disable) &&
-	__debugfs_create(u32, "vpp_delay", &msm_vidc_vpp_delay);
+	__debugfs_create(u32, "vpp_delay", &msm_vidc_vpp_delay) &&
+	__debugfs_create(bool, "pc_prediction", &msm_vidc_pc_prediction) &&
+	__debugfs_create(bool, "pc_spec_resume", &msm_vidc_pc_spec_resume) &&
+	__debugfs_create(bool, "bus_restore_vote",
+			&msm_vidc_bus_restore_vote) &&
+	__debugfs_create(u32, "fw_retain_max_ms",
+			&msm_vidc_fw_retain_max_ms) &&
+	__debugfs_create(u32, "internal_pool_max_kb",
+			&msm_vidc_internal_pool_max_kb) &&
+	__debugfs_create(bool, "input_only_flush",
+			&msm_vidc_input_only_flush) &&
+	__debugfs_create(bool, "admission_degrade",
+			&msm_vidc_admission_degrade) &&
+	__debugfs_create(u32, "msgq_poll_us", &msm_vidc_msgq_poll_us) &&
+	__debugfs_create(u32, "msgq_poll_min", &msm_vidc_msgq_poll_min) &&
+	__debugfs_create(bool, "cb_demux", &msm_vidc_cb_demux) &&
+	__debugfs_create(bool, "adaptive_bitstream",
+			&msm_vidc_adaptive_bitstream);
 
 #undef __debugfs_create
 
@@ -281,6 +429,11 @@ struct dentry *msm_vidc_debugfs_init_core(struct msm_vidc_core *core,
 		d_vpr_e("debugfs_create_file: fail\n");
 		goto failed_create_dir;
 	}
+	if (!debugfs_create_file("pm_stats", 0444,
+			dir, core, &pm_stats_fops)) {
+		d_vpr_e("debugfs_create_file: fail\n");
+		goto failed_create_dir;
+	}
 	if (!debugfs_create_file("trigger_ssr", 0200,
 			dir, core, &ssr_fops)) {
 		d_vpr_e("debugfs_create_file: fail\n");
@@ -446,6 +599,28 @@ static ssize_t inst_info_read(struct file *file, char __user *buf,
 	cur += write_str(cur, end - cur, "EBD Count: %d\n", inst->count.ebd);
 	cur += write_str(cur, end - cur, "FTB Count: %d\n", inst->count.ftb);
 	cur += write_str(cur, end - cur, "FBD Count: %d\n", inst->count.fbd);
+	cur += write_str(cur, end - cur,
+		"Flush Count: %u (input only: %u)\n",
+		inst->flush_stats.count, inst->flush_stats.input_only);
+	cur += write_str(cur, end - cur,
+		"Flush latency: last %u us avg %u us max %u us\n",
+		inst->flush_stats.last_us, inst->flush_stats.avg_us,
+		inst->flush_stats.max_us);
+	cur += write_str(cur, end - cur, "Flush to first FBD: %u us\n",
+		inst->flush_stats.first_fbd_us);
+	cur += write_str(cur, end - cur,
+		"Memory: input %llu KB output %llu KB dpb %llu KB internal %llu KB total %llu KB\n",
+		inst->mem_usage[MSM_VIDC_MEM_INPUT] >> 10,
+		inst->mem_usage[MSM_VIDC_MEM_OUTPUT] >> 10,
+		inst->mem_usage[MSM_VIDC_MEM_DPB] >> 10,
+		inst->mem_usage[MSM_VIDC_MEM_INTERNAL] >> 10,
+		inst->mem_usage_total >> 10);
+	cur += write_str(cur, end - cur,
+		"Bitstream: frames %u max filled %u at %u mbs%s\n",
+		inst->bitstream_stats.frames,
+		inst->bitstream_stats.max_filled_len,
+		inst->bitstream_stats.mbs,
+		inst->bitstream_stats.overflow ? " (overflowed)" : "");
 
 	publish_unreleased_reference(inst, &cur, end);
 	len = simple_read_from_buffer(buf, count, ppos,
@@ -102,6 +102,17 @@ extern bool msm_vidc_lossless_encode;
 extern bool msm_vidc_cvp_usage;
 extern int msm_vidc_err_recovery_disable;
 extern int msm_vidc_vpp_delay;
+extern bool msm_vidc_pc_prediction;
+extern bool msm_vidc_pc_spec_resume;
+extern bool msm_vidc_bus_restore_vote;
+extern int msm_vidc_fw_retain_max_ms;
+extern int msm_vidc_internal_pool_max_kb;
+extern bool msm_vidc_input_only_flush;
+extern bool msm_vidc_admission_degrade;
+extern int msm_vidc_msgq_poll_us;
+extern int msm_vidc_msgq_poll_min;
+extern bool msm_vidc_cb_demux;
+extern bool msm_vidc_adaptive_bitstream;
 
 #define dprintk(__level, sid, __fmt, ...)	\
 	do { \
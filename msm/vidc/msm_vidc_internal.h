@@ -14,6 +14,7 @@
 #include <media/videobuf2-core.h>
 #include <media/videobuf2-v4l2.h>
 #include <linux/interconnect.h>
+#include <linux/shrinker.h>
 #include "msm_vidc.h"
 #include "vidc/media/msm_media_info.h"
 #include "vidc_hfi_api.h"
@@ -188,6 +189,12 @@ struct internal_buf {
 	bool mark_remove;
 };
 
+struct msm_vidc_pool_buf {
+	struct list_head list;
+	enum session_type session_type;
+	struct msm_smem smem;
+};
+
 struct msm_vidc_csc_coeff {
 	u32 *vpe_csc_custom_matrix_coeff;
 	u32 *vpe_csc_custom_bias_coeff;
@@ -388,6 +395,25 @@ struct buf_count {
 	int ebd;
 };
 
+struct msm_vidc_flush_stats {
+	u64 start_ns;
+	bool fbd_pending;
+	u32 count;
+	u32 input_only;
+	u32 last_us;
+	u32 avg_us;
+	u32 max_us;
+	u32 first_fbd_us;
+};
+
+enum msm_vidc_mem_type {
+	MSM_VIDC_MEM_INPUT,
+	MSM_VIDC_MEM_OUTPUT,
+	MSM_VIDC_MEM_DPB,
+	MSM_VIDC_MEM_INTERNAL,
+	MSM_VIDC_MEM_MAX,
+};
+
 struct batch_mode {
 	bool enable;
 	u32 size;
@@ -423,6 +449,7 @@ struct clock_data {
 	u32 work_route;
 	u32 dcvs_flags;
 	u32 frame_rate;
+	bool power_mode_set;
 };
 
 struct vidc_bus_vote_data {
@@ -476,6 +503,7 @@ struct msm_vidc_core_ops {
 	int (*decide_work_mode)(struct msm_vidc_inst *inst);
 	int (*decide_core_and_power_mode)(struct msm_vidc_inst *inst);
 	int (*calc_bw)(struct vidc_bus_vote_data *vidc_data);
+	void (*balance_core)(struct msm_vidc_core *core);
 };
 
 struct msm_vidc_ssr {
@@ -484,6 +512,48 @@ struct msm_vidc_ssr {
 	u32 test_addr;
 };
 
+#define MSM_VIDC_BUF_SIZE_CACHE_ENTRIES 8
+
+/* every input of the internal buffer size calculators */
+struct msm_vidc_buf_size_key {
+	u32 session_type;
+	u32 fourcc;
+	u32 width;
+	u32 height;
+	u32 num_vpp_pipes;
+	u32 interlaced;
+	u32 vpp_delay;
+	u32 out_min_count;
+	u32 split_mode;
+	u32 work_mode;
+	u32 num_ref;
+	u32 ten_bit;
+	u32 downscale;
+	u32 rotation;
+	u32 flip;
+	u32 rc_type;
+	u32 grid;
+	u32 image;
+	u32 bitstream_size;
+};
+
+struct msm_vidc_buf_size_entry {
+	bool valid;
+	struct msm_vidc_buf_size_key key;
+	u32 scratch;
+	u32 scratch1;
+	u32 scratch2;
+	u32 persist;
+};
+
+struct msm_vidc_buf_size_cache {
+	struct mutex lock;
+	struct msm_vidc_buf_size_entry entries[MSM_VIDC_BUF_SIZE_CACHE_ENTRIES];
+	u32 next;
+	u32 hits;
+	u32 misses;
+};
+
 struct msm_vidc_core {
 	struct list_head list;
 	struct mutex lock;
@@ -509,6 +579,22 @@ struct msm_vidc_core {
 	unsigned long curr_freq;
 	struct msm_vidc_core_ops *core_ops;
 	bool pm_suspended;
+	u64 fw_idle_ns;
+	u32 fw_reopen_gap_ms;
+	u32 fw_warm_opens;
+	u32 fw_cold_opens;
+	struct v4l2_ctrl_config *ctrl_tmpl[MSM_VIDC_MAX_DEVICES];
+	struct msm_vidc_list internal_pool;
+	u64 internal_pool_size;
+	u32 internal_pool_hits;
+	u32 internal_pool_misses;
+	struct shrinker internal_pool_shrinker;
+	struct msm_vidc_buf_size_cache buf_size_cache;
+	u64 mem_total;
+	u64 mem_non_secure;
+	u32 mem_limit_mbytes;
+	u32 admission_demotions;
+	u32 admission_preemptions;
 };
 
 struct msm_vidc_inst;
@@ -540,6 +626,7 @@ struct msm_vidc_inst {
 	struct msm_vidc_list refbufs;
 	struct msm_vidc_list eosbufs;
 	struct msm_vidc_list registeredbufs;
+	struct msm_vidc_list prepared_bufs;
 	struct msm_vidc_list etb_data;
 	struct msm_vidc_list fbd_data;
 	struct msm_vidc_list window_data;
@@ -567,8 +654,13 @@ struct msm_vidc_inst {
 	u32 num_ctrls;
 	int bit_depth;
 	struct kref kref;
+	struct rcu_head rcu;
 	bool in_flush;
 	bool out_flush;
+	struct msm_vidc_flush_stats flush_stats;
+	u64 mem_usage[MSM_VIDC_MEM_MAX];
+	u64 mem_usage_total;
+	u64 mem_usage_non_secure;
 	bool flush_timestamps;
 	u32 pic_struct;
 	u32 colour_space;
@@ -593,7 +685,7 @@ struct msm_vidc_inst {
 	int (*buffer_size_calculators)(struct msm_vidc_inst *inst);
 	bool all_intra;
 	bool is_perf_eligible_session;
-	u32 max_filled_len;
+	struct msm_vidc_bitstream_stats bitstream_stats;
 	int full_range;
 	struct mutex ubwc_stats_lock;
 	struct msm_vidc_ubwc_stats ubwc_stats;
@@ -601,6 +693,7 @@ struct msm_vidc_inst {
 	u32 first_reconfig_done;
 	u64 last_qbuf_time_ns;
 	bool active;
+	bool release_res_posted;
 	bool has_bframe;
 	bool boost_enabled;
 	bool boost_qp_enabled;
@@ -645,17 +738,45 @@ struct msm_vidc_buffer {
 	enum msm_vidc_flags flags;
 };
 
+/* filled lengths seen on the compressed port, for adaptive sizing */
+struct msm_vidc_bitstream_stats {
+	u32 frames;
+	u32 max_filled_len;
+	u32 mbs;
+	bool overflow;
+};
+
+/* client buffer plane imported and mapped ahead of qbuf */
+struct msm_vidc_prepared_buf {
+	struct list_head list;
+	struct kref kref;
+	struct msm_vidc_inst *inst;
+	u32 type;
+	u32 index;
+	u32 plane;
+	struct msm_smem smem;
+	/* bytes handed to the client by the last dqbuf, under registeredbufs */
+	bool client_len_valid;
+	u32 client_len;
+};
+
 void msm_comm_handle_thermal_event(void);
 int msm_smem_alloc(size_t size, u32 align, u32 flags,
 	enum hal_buffer buffer_type, int map_kernel,
 	void  *res, u32 session_type, struct msm_smem *smem, u32 sid);
 int msm_smem_free(struct msm_smem *smem, u32 sid);
+int msm_smem_clear(struct msm_smem *smem, u32 sid);
 
 struct context_bank_info *msm_smem_get_context_bank(u32 session_type,
 	bool is_secure, struct msm_vidc_platform_resources *res,
 	enum hal_buffer buffer_type, u32 sid);
 int msm_smem_map_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem);
+int msm_smem_map_dma_buf_ref(struct msm_vidc_inst *inst,
+	struct msm_smem *smem, struct dma_buf *dbuf);
 int msm_smem_unmap_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem);
+int msm_smem_map_prepared(struct msm_vidc_inst *inst, struct msm_smem *smem,
+	struct msm_vidc_prepared_buf *pbuf);
+void msm_smem_put_prepared(struct msm_vidc_prepared_buf *pbuf);
 struct dma_buf *msm_smem_get_dma_buf(int fd, u32 sid);
 void msm_smem_put_dma_buf(void *dma_buf, u32 sid);
 int msm_smem_cache_operations(struct dma_buf *dbuf,
@@ -807,6 +807,8 @@ int read_platform_resources_from_drv_data(
 			"qcom,domain-attr-cache-pagetables");
 	res->decode_batching = find_key_value(platform_data,
 			"qcom,decode-batching");
+	res->batch_release_bufs = find_key_value(platform_data,
+			"qcom,batch-release-buffers");
 	res->batch_timeout = find_key_value(platform_data,
 			"qcom,batch-timeout");
 	res->dcvs = find_key_value(platform_data,
@@ -187,6 +187,7 @@ struct msm_vidc_platform_resources {
 	bool non_fatal_pagefaults;
 	bool cache_pagetables;
 	bool decode_batching;
+	bool batch_release_bufs;
 	uint32_t batch_timeout;
 	bool dcvs;
 	struct msm_vidc_codec_data *codec_data;
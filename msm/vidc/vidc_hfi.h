@@ -821,6 +821,10 @@ struct hal_session {
 	enum hal_domain domain;
 	u32 flags;
 	u32 sid;
+	u64 last_etb_ns;
+	u64 etb_interval_ns;
+	atomic_t etb_pending;
+	struct rcu_head rcu;
 };
 
 struct hal_device_data {
@@ -52,6 +52,11 @@
 
 /* 16 video sessions */
 #define VIDC_MAX_SESSIONS               16
+/*
+ * session ids are log context slots, 1 to max_inst_count; probe checks
+ * max_inst_count (at most MAX_SUPPORTED_INSTANCES_24) against this
+ */
+#define VIDC_MAX_SESSION_ID             24
 
 enum vidc_status {
 	VIDC_ERR_NONE = 0x0,
@@ -312,6 +317,9 @@ struct vidc_resource_hdr {
 	void *resource_handle;
 };
 
+/* Max addresses carried by one batched release buffers packet */
+#define HAL_MAX_RELEASE_BUFFERS 32
+
 struct vidc_buffer_addr_info {
 	enum hal_buffer buffer_type;
 	u32 buffer_size;
@@ -320,6 +328,8 @@ struct vidc_buffer_addr_info {
 	u32 extradata_addr;
 	u32 extradata_size;
 	u32 response_required;
+	/* optional, num_buffers addresses of a batched release */
+	u32 *device_addrs;
 };
 
 /* Needs to be exactly the same as hfi_buffer_info */
@@ -355,6 +365,47 @@ struct vidc_frame_data {
 	u32 extradata_size;
 };
 
+#define HAL_PM_RESUME_HIST_BUCKETS 6
+
+enum hal_lock_id {
+	HAL_LOCK_DEVICE,
+	HAL_LOCK_RESP,
+	HAL_LOCK_RES,
+	HAL_LOCK_MAX,
+};
+
+struct hal_lock_stats {
+	u32 acquired;
+	u32 contended;
+	u64 wait_us;
+	u32 max_wait_us;
+};
+
+struct hal_pm_stats {
+	u32 collapses;
+	u32 early_collapses;
+	u32 resumes;
+	u32 mispredict_early;
+	u32 mispredict_held;
+	u32 resume_hist[HAL_PM_RESUME_HIST_BUCKETS];
+	u32 resume_avg_us;
+	u32 resume_max_us;
+	u32 spec_resumes;
+	u32 spec_hits;
+	u32 spec_late;
+	u32 spec_wasted;
+	u32 bus_restores;
+	u32 bus_restore_low;
+	u32 msgq_batches;
+	u32 msgq_packets;
+	u32 msgq_copies;
+	u32 interrupts;
+	u32 frames;
+	u32 poll_rounds;
+	u32 poll_packets;
+	struct hal_lock_stats locks[HAL_LOCK_MAX];
+};
+
 struct hal_fw_info {
 	char version[VENUS_VERSION_LENGTH];
 	phys_addr_t base_addr;
@@ -588,6 +639,7 @@ struct msm_vidc_cb_data_done {
 
 struct msm_vidc_cb_info {
 	enum hal_command_response response_type;
+	u32 sid;
 	union {
 		struct msm_vidc_cb_cmd_done cmd;
 		struct msm_vidc_cb_event event;
@@ -670,6 +722,7 @@ struct hfi_device {
 	int (*vote_bus)(void *dev, unsigned long bw_ddr,
 			unsigned long bw_llcc, u32 sid);
 	int (*get_fw_info)(void *dev, struct hal_fw_info *fw_info);
+	int (*get_pm_stats)(void *dev, struct hal_pm_stats *stats);
 	int (*session_clean)(void *sess);
 	int (*get_core_capabilities)(void *dev);
 	int (*suspend)(void *dev);
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+/*
+ * Userspace microbenchmark for hfi_ring.h. A producer thread plays the
+ * host side of the command queue and a consumer thread drains it like
+ * __read_queue(), both on a ring of the size the driver allocates. The
+ * packets cycle through the steady state mix of a decode and an encode
+ * session, sized after the HFI structs they stand for.
+ *
+ * usage: hfi_ring_bench [packets]
+ * Every packet carries its sequence number, so the run fails on any
+ * lost, reordered or torn packet.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hfi_ring.h"
+
+/* VIDC_IFACEQ_MAX_PKT_SIZE * VIDC_IFACEQ_MAX_BUF_COUNT * 16 clients */
+#define BENCH_QUEUE_SIZE (1024 * 50 * 16)
+/* VIDC_IFACEQ_VAR_HUGE_PKT_SIZE */
+#define BENCH_MAX_PKT_SIZE (1024 * 12)
+#define BENCH_DEFAULT_PACKETS 20000000UL
+
+static const u32 packet_words[] = {
+	15,	/* hfi_cmd_session_empty_buffer_compressed_packet */
+	11,	/* hfi_cmd_session_fill_buffer_packet */
+	20,	/* hfi_msg_session_empty_buffer_done_packet */
+	25,	/* hfi_msg_session_fbd_uncompressed_plane0_packet */
+	16,	/* hfi_cmd_session_empty_buffer_uncompressed_plane0_packet */
+	11,	/* hfi_cmd_session_fill_buffer_packet */
+	20,	/* hfi_msg_session_empty_buffer_done_packet */
+	18,	/* hfi_msg_session_fill_buffer_done_compressed_packet */
+	7,	/* hfi_msg_event_notify_packet */
+	6,	/* hfi_cmd_session_set_property_packet, one u32 property */
+};
+
+#define NUM_PACKET_SIZES (sizeof(packet_words) / sizeof(packet_words[0]))
+
+struct bench_queue {
+	/* the indices live in the queue header, apart from the payload */
+	u32 read_idx __attribute__((aligned(64)));
+	u32 write_idx __attribute__((aligned(64)));
+	u32 payload[BENCH_QUEUE_SIZE / 4] __attribute__((aligned(64)));
+};
+
+struct bench {
+	struct bench_queue *queue;
+	unsigned long packets;
+	unsigned long errors;
+	unsigned long full_spins;
+	unsigned long empty_spins;
+};
+
+static void *producer(void *arg)
+{
+	struct bench *b = arg;
+	struct hfi_ring ring;
+	struct hfi_ring_span span;
+	u32 packet[BENCH_MAX_PKT_SIZE / 4] = {0};
+	unsigned long seq;
+	u32 words;
+	int rc;
+
+	hfi_ring_init(&ring, b->queue->payload, BENCH_QUEUE_SIZE,
+		&b->queue->read_idx, &b->queue->write_idx);
+
+	for (seq = 0; seq < b->packets; seq++) {
+		words = packet_words[seq % NUM_PACKET_SIZES];
+		packet[0] = words << 2;
+		packet[1] = (u32)seq;
+		packet[words - 1] = ~(u32)seq;
+
+		while ((rc = hfi_ring_reserve(&ring, words, &span)) ==
+				-ENOSPC) {
+			b->full_spins++;
+			sched_yield();
+		}
+		if (rc) {
+			b->errors++;
+			break;
+		}
+		hfi_ring_write(&ring, &span, packet);
+		hfi_ring_commit(&ring, &span);
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct bench *b = arg;
+	struct hfi_ring ring;
+	u32 packet[BENCH_MAX_PKT_SIZE / 4];
+	unsigned long seq = 0;
+	u32 read, write, words;
+
+	hfi_ring_init(&ring, b->queue->payload, BENCH_QUEUE_SIZE,
+		&b->queue->read_idx, &b->queue->write_idx);
+
+	while (seq < b->packets) {
+		if (hfi_ring_peek(&ring, &read, &write)) {
+			b->empty_spins++;
+			sched_yield();
+			continue;
+		}
+
+		/* drain everything published, as the response worker does */
+		while (read != write) {
+			words = *hfi_ring_ptr(&ring, read) >> 2;
+			if (words != packet_words[seq % NUM_PACKET_SIZES]) {
+				b->errors++;
+				return NULL;
+			}
+			read = hfi_ring_read(&ring, read, packet, words);
+			if (packet[1] != (u32)seq ||
+				packet[words - 1] != ~(u32)seq)
+				b->errors++;
+			seq++;
+		}
+		hfi_ring_consume(&ring, read);
+	}
+
+	return NULL;
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench b = { .packets = BENCH_DEFAULT_PACKETS };
+	pthread_t prod, cons;
+	unsigned long bytes = 0, i;
+	double start, elapsed;
+
+	if (argc > 1)
+		b.packets = strtoul(argv[1], NULL, 0);
+
+	b.queue = aligned_alloc(64, sizeof(*b.queue));
+	if (!b.queue)
+		return 1;
+	memset(b.queue, 0, sizeof(*b.queue));
+
+	for (i = 0; i < NUM_PACKET_SIZES; i++)
+		bytes += packet_words[i] << 2;
+	bytes = bytes * (b.packets / NUM_PACKET_SIZES);
+
+	start = now_sec();
+	if (pthread_create(&cons, NULL, consumer, &b) ||
+		pthread_create(&prod, NULL, producer, &b))
+		return 1;
+	pthread_join(prod, NULL);
+	pthread_join(cons, NULL);
+	elapsed = now_sec() - start;
+
+	printf("%lu packets in %.3f s: %.2f Mpkt/s, %.1f MB/s\n",
+		b.packets, elapsed, b.packets / elapsed / 1e6,
+		bytes / elapsed / 1e6);
+	printf("producer full spins %lu, consumer empty spins %lu\n",
+		b.full_spins, b.empty_spins);
+
+	if (b.errors) {
+		printf("FAILED: %lu corrupt packets\n", b.errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,377 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include <tuple>
+#include <vector>
+
+extern "C" {
+#include "msm_vidc_common.h"
+#include "msm_vidc_debug.h"
+#include "msm_vidc_buffer_calculations.h"
+
+int msm_vidc_get_decoder_internal_buffer_sizes(struct msm_vidc_inst *inst);
+int msm_vidc_get_encoder_internal_buffer_sizes(struct msm_vidc_inst *inst);
+int msm_vidc_calculate_internal_buffer_sizes(struct msm_vidc_inst *inst);
+
+int msm_vidc_vpp_delay;
+bool msm_vidc_adaptive_bitstream;
+}
+
+namespace {
+
+const enum hal_buffer internal_types[] = {
+	HAL_BUFFER_INTERNAL_SCRATCH,
+	HAL_BUFFER_INTERNAL_SCRATCH_1,
+	HAL_BUFFER_INTERNAL_SCRATCH_2,
+	HAL_BUFFER_INTERNAL_PERSIST,
+	HAL_BUFFER_INTERNAL_PERSIST_1,
+};
+
+struct Sizes {
+	u32 size[5];
+
+	bool operator==(const Sizes &o) const
+	{
+		return !memcmp(size, o.size, sizeof(size));
+	}
+};
+
+std::ostream &operator<<(std::ostream &os, const Sizes &s)
+{
+	os << "{";
+	for (u32 v : s.size)
+		os << " " << v;
+	return os << " }";
+}
+
+struct EncConfig {
+	u32 fourcc;
+	u32 width;
+	u32 height;
+	u32 rc_type;
+	s32 grid;
+	s32 rotation;
+	s32 bframes;
+	u32 bit_depth;
+};
+
+struct DecConfig {
+	u32 fourcc;
+	u32 width;
+	u32 height;
+	u32 pic_struct;
+	u32 output_mode;
+	u32 vpp_delay;
+	u32 count_min;
+};
+
+class BufferSizeTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		platform_data.vpu_ver = VPU_VERSION_IRIS2;
+		platform_data.num_vpp_pipes = 4;
+		shared = new_core();
+	}
+
+	msm_vidc_core new_core()
+	{
+		msm_vidc_core core = {};
+
+		core.platform_data = &platform_data;
+		return core;
+	}
+
+	static void init_inst(msm_vidc_inst *inst, msm_vidc_core *core,
+		enum session_type type)
+	{
+		static const u32 ids[] = {
+			V4L2_CID_ROTATE,
+			V4L2_CID_HFLIP,
+			V4L2_CID_VFLIP,
+			V4L2_CID_MPEG_VIDEO_B_FRAMES,
+			V4L2_CID_MPEG_VIDC_VIDEO_LTRCOUNT,
+			V4L2_CID_MPEG_VIDEO_HEVC_HIER_CODING_TYPE,
+			V4L2_CID_MPEG_VIDC_VIDEO_HEVC_MAX_HIER_CODING_LAYER,
+			V4L2_CID_MPEG_VIDC_IMG_GRID_SIZE,
+			V4L2_CID_MPEG_VIDC_VDEC_HEIF_MODE,
+			V4L2_CID_MPEG_VIDC_VIDEO_PRIORITY,
+		};
+		u32 i;
+
+		*inst = {};
+		inst->core = core;
+		inst->session_type = type;
+		inst->state = MSM_VIDC_OPEN_DONE;
+		for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+			inst->ctrls[i].id = ids[i];
+		inst->num_ctrls = i;
+		get_ctrl(inst, V4L2_CID_MPEG_VIDEO_HEVC_HIER_CODING_TYPE)->val =
+			V4L2_MPEG_VIDEO_HEVC_HIERARCHICAL_CODING_P;
+		for (i = 0; i < 5; i++)
+			inst->buff_req.buffer[i].buffer_type = internal_types[i];
+	}
+
+	static void init_enc(msm_vidc_inst *inst, msm_vidc_core *core,
+		const EncConfig &c)
+	{
+		v4l2_pix_format_mplane *pix;
+
+		init_inst(inst, core, MSM_VIDC_ENCODER);
+		pix = &inst->fmts[OUTPUT_PORT].v4l2_fmt.fmt.pix_mp;
+		pix->pixelformat = c.fourcc;
+		pix->width = c.width;
+		pix->height = c.height;
+		pix = &inst->fmts[INPUT_PORT].v4l2_fmt.fmt.pix_mp;
+		pix->pixelformat = V4L2_PIX_FMT_NV12_UBWC;
+		pix->width = c.width;
+		pix->height = c.height;
+		inst->rc_type = c.rc_type;
+		inst->bit_depth = c.bit_depth;
+		inst->clk_data.work_mode = HFI_WORKMODE_2;
+		get_ctrl(inst, V4L2_CID_MPEG_VIDC_IMG_GRID_SIZE)->val = c.grid;
+		get_ctrl(inst, V4L2_CID_ROTATE)->val = c.rotation;
+		get_ctrl(inst, V4L2_CID_MPEG_VIDEO_B_FRAMES)->val = c.bframes;
+	}
+
+	static void init_dec(msm_vidc_inst *inst, msm_vidc_core *core,
+		const DecConfig &c)
+	{
+		v4l2_pix_format_mplane *pix;
+
+		init_inst(inst, core, MSM_VIDC_DECODER);
+		pix = &inst->fmts[INPUT_PORT].v4l2_fmt.fmt.pix_mp;
+		pix->pixelformat = c.fourcc;
+		pix->width = c.width;
+		pix->height = c.height;
+		pix = &inst->fmts[OUTPUT_PORT].v4l2_fmt.fmt.pix_mp;
+		pix->pixelformat = V4L2_PIX_FMT_NV12_UBWC;
+		pix->width = c.width;
+		pix->height = c.height;
+		inst->pic_struct = c.pic_struct;
+		inst->stream_output_mode = c.output_mode;
+		inst->bse_vpp_delay = c.vpp_delay;
+		inst->fmts[OUTPUT_PORT].count_min = c.count_min;
+	}
+
+	static Sizes sizes_of(msm_vidc_inst *inst)
+	{
+		Sizes s;
+
+		for (u32 i = 0; i < 5; i++)
+			s.size[i] = inst->buff_req.buffer[i].buffer_size;
+		return s;
+	}
+
+	/* sizes computed on a core that has never seen another session */
+	template <typename Config, typename Init>
+	Sizes uncached(const Config &c, Init init)
+	{
+		msm_vidc_core core = new_core();
+		msm_vidc_inst inst;
+
+		init(&inst, &core, c);
+		EXPECT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+		EXPECT_EQ(core.buf_size_cache.misses, 1u);
+		return sizes_of(&inst);
+	}
+
+	/* sizes computed twice on the shared core, the second from its cache */
+	template <typename Config, typename Init>
+	void expect_cached_matches(const Config &c, Init init)
+	{
+		Sizes expected = uncached(c, init);
+		msm_vidc_inst inst;
+		u32 hits;
+
+		init(&inst, &shared, c);
+		ASSERT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+		EXPECT_EQ(sizes_of(&inst), expected);
+
+		hits = shared.buf_size_cache.hits;
+		init(&inst, &shared, c);
+		ASSERT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+		EXPECT_EQ(shared.buf_size_cache.hits, hits + 1);
+		EXPECT_EQ(sizes_of(&inst), expected);
+		EXPECT_FALSE(shared.buf_size_cache.lock.held);
+	}
+
+	msm_vidc_platform_data platform_data;
+	msm_vidc_core shared;
+};
+
+TEST_F(BufferSizeTest, EncoderCacheMatchesCalculators)
+{
+	const u32 codecs[] = {
+		V4L2_PIX_FMT_H264, V4L2_PIX_FMT_HEVC, V4L2_PIX_FMT_VP8,
+	};
+	const std::pair<u32, u32> resolutions[] = {
+		{ 320, 240 }, { 1280, 720 }, { 1920, 1080 }, { 4096, 2160 },
+	};
+	const u32 rc_types[] = {
+		V4L2_MPEG_VIDEO_BITRATE_MODE_VBR,
+		V4L2_MPEG_VIDEO_BITRATE_MODE_CBR,
+		V4L2_MPEG_VIDEO_BITRATE_MODE_CQ,
+		RATE_CONTROL_OFF,
+		RATE_CONTROL_LOSSLESS,
+	};
+	const s32 grids[] = { 0, 1 };
+	const s32 rotations[] = { 0, 90 };
+	const s32 bframes[] = { 0, 1 };
+	const u32 depths[] = { MSM_VIDC_BIT_DEPTH_8, MSM_VIDC_BIT_DEPTH_10 };
+	auto init = [](msm_vidc_inst *inst, msm_vidc_core *core,
+		const EncConfig &c) { init_enc(inst, core, c); };
+
+	for (u32 fourcc : codecs)
+	for (auto res : resolutions)
+	for (u32 rc : rc_types)
+	for (s32 grid : grids)
+	for (s32 rotation : rotations)
+	for (s32 b : bframes)
+	for (u32 depth : depths) {
+		EncConfig c = { fourcc, res.first, res.second, rc, grid,
+			rotation, b, depth };
+
+		SCOPED_TRACE(::testing::Message() << std::hex << fourcc
+			<< std::dec << " " << res.first << "x" << res.second
+			<< " rc " << rc << " grid " << grid << " rot "
+			<< rotation << " b " << b << " depth " << depth);
+		expect_cached_matches(c, init);
+	}
+}
+
+TEST_F(BufferSizeTest, EncoderSizesArePopulated)
+{
+	EncConfig c = { V4L2_PIX_FMT_HEVC, 1920, 1080,
+		V4L2_MPEG_VIDEO_BITRATE_MODE_VBR, 0, 0, 0, MSM_VIDC_BIT_DEPTH_8 };
+	msm_vidc_inst inst;
+	Sizes s;
+
+	init_enc(&inst, &shared, c);
+	ASSERT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+	s = sizes_of(&inst);
+	EXPECT_GT(s.size[0], 0u);
+	EXPECT_GT(s.size[1], 0u);
+	EXPECT_GT(s.size[2], 0u);
+	EXPECT_GT(s.size[3], 0u);
+	/* PERSIST_1 belongs to decoders */
+	EXPECT_EQ(s.size[4], 0u);
+}
+
+TEST_F(BufferSizeTest, EncoderKeyTracksRcType)
+{
+	EncConfig vbr = { V4L2_PIX_FMT_H264, 1920, 1080,
+		V4L2_MPEG_VIDEO_BITRATE_MODE_VBR, 0, 0, 0, MSM_VIDC_BIT_DEPTH_8 };
+	EncConfig lossless = vbr;
+	msm_vidc_inst inst;
+	Sizes s;
+
+	lossless.rc_type = RATE_CONTROL_LOSSLESS;
+	init_enc(&inst, &shared, vbr);
+	ASSERT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+	s = sizes_of(&inst);
+
+	/* the bitbin sizes follow the output frame size of the rc mode */
+	init_enc(&inst, &shared, lossless);
+	ASSERT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+	EXPECT_EQ(shared.buf_size_cache.misses, 2u);
+	EXPECT_NE(sizes_of(&inst).size[0], s.size[0]);
+}
+
+TEST_F(BufferSizeTest, DecoderCacheMatchesCalculators)
+{
+	const u32 codecs[] = {
+		V4L2_PIX_FMT_H264, V4L2_PIX_FMT_HEVC, V4L2_PIX_FMT_VP8,
+		V4L2_PIX_FMT_VP9, V4L2_PIX_FMT_MPEG2,
+	};
+	const std::pair<u32, u32> resolutions[] = {
+		{ 320, 240 }, { 1280, 720 }, { 1920, 1080 }, { 4096, 2160 },
+		{ 7680, 4320 },
+	};
+	const u32 pic_structs[] = {
+		MSM_VIDC_PIC_STRUCT_PROGRESSIVE,
+		MSM_VIDC_PIC_STRUCT_MAYBE_INTERLACED,
+	};
+	const u32 output_modes[] = {
+		HAL_VIDEO_DECODER_PRIMARY, HAL_VIDEO_DECODER_SECONDARY,
+	};
+	const u32 vpp_delays[] = { 0, MAX_BSE_VPP_DELAY };
+	const u32 count_mins[] = { 4, 9 };
+	auto init = [](msm_vidc_inst *inst, msm_vidc_core *core,
+		const DecConfig &c) { init_dec(inst, core, c); };
+
+	for (u32 fourcc : codecs)
+	for (auto res : resolutions)
+	for (u32 pic_struct : pic_structs)
+	for (u32 mode : output_modes)
+	for (u32 delay : vpp_delays)
+	for (u32 count_min : count_mins) {
+		DecConfig c = { fourcc, res.first, res.second, pic_struct, mode,
+			delay, count_min };
+
+		SCOPED_TRACE(::testing::Message() << std::hex << fourcc
+			<< std::dec << " " << res.first << "x" << res.second
+			<< " pic_struct " << pic_struct << " mode " << mode
+			<< " delay " << delay << " count_min " << count_min);
+		expect_cached_matches(c, init);
+	}
+}
+
+TEST_F(BufferSizeTest, DecoderSizesArePopulated)
+{
+	DecConfig c = { V4L2_PIX_FMT_H264, 1920, 1080,
+		MSM_VIDC_PIC_STRUCT_PROGRESSIVE, HAL_VIDEO_DECODER_PRIMARY, 0, 4 };
+	msm_vidc_inst inst;
+	Sizes s;
+
+	init_dec(&inst, &shared, c);
+	ASSERT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+	s = sizes_of(&inst);
+	EXPECT_GT(s.size[0], 0u);
+	EXPECT_GT(s.size[1], 0u);
+	/* SCRATCH_2 and PERSIST belong to encoders */
+	EXPECT_EQ(s.size[2], 0u);
+	EXPECT_EQ(s.size[3], 0u);
+	EXPECT_GT(s.size[4], 0u);
+}
+
+TEST_F(BufferSizeTest, DecoderKeyTracksOutputCount)
+{
+	DecConfig c = { V4L2_PIX_FMT_HEVC, 1920, 1080,
+		MSM_VIDC_PIC_STRUCT_PROGRESSIVE, HAL_VIDEO_DECODER_PRIMARY, 0, 4 };
+	msm_vidc_inst inst;
+	Sizes s;
+
+	init_dec(&inst, &shared, c);
+	ASSERT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+	s = sizes_of(&inst);
+
+	/* co-located motion vectors scale with the output buffer count */
+	c.count_min = 16;
+	init_dec(&inst, &shared, c);
+	ASSERT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), 0);
+	EXPECT_EQ(shared.buf_size_cache.misses, 2u);
+	EXPECT_GT(sizes_of(&inst).size[1], s.size[1]);
+}
+
+TEST_F(BufferSizeTest, UnsupportedCodecIsRejected)
+{
+	EncConfig enc = { V4L2_PIX_FMT_VP9, 1920, 1080,
+		V4L2_MPEG_VIDEO_BITRATE_MODE_VBR, 0, 0, 0, MSM_VIDC_BIT_DEPTH_8 };
+	DecConfig dec = { V4L2_PIX_FMT_NV12_UBWC, 1920, 1080,
+		MSM_VIDC_PIC_STRUCT_PROGRESSIVE, HAL_VIDEO_DECODER_PRIMARY, 0, 4 };
+	msm_vidc_inst inst;
+
+	init_enc(&inst, &shared, enc);
+	EXPECT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), -EINVAL);
+	init_dec(&inst, &shared, dec);
+	EXPECT_EQ(msm_vidc_calculate_internal_buffer_sizes(&inst), -EINVAL);
+	EXPECT_EQ(shared.buf_size_cache.hits + shared.buf_size_cache.misses,
+		0u);
+}
+
+} // namespace
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+/*
+ * The firmware side of the ring is another thread here, so the dma_*
+ * barriers map to the C11 fences with the same ordering.
+ */
+
+#ifndef __VIDC_TEST_ASM_BARRIER_H__
+#define __VIDC_TEST_ASM_BARRIER_H__
+
+#define mb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define dma_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define dma_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+#endif
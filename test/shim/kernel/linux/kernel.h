@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+/* userspace stand-ins for the kernel headers included by hfi_ring.h */
+
+#ifndef __VIDC_TEST_LINUX_KERNEL_H__
+#define __VIDC_TEST_LINUX_KERNEL_H__
+
+#include <linux/types.h>
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+#endif
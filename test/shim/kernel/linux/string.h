@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+#ifndef __VIDC_TEST_LINUX_STRING_H__
+#define __VIDC_TEST_LINUX_STRING_H__
+
+#include <string.h>
+
+#endif
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+#ifndef _MSM_VIDC_CLOCKS_H_
+#define _MSM_VIDC_CLOCKS_H_
+
+#include "msm_vidc_common.h"
+
+static inline int msm_vidc_get_mbs_per_frame(struct msm_vidc_inst *inst)
+{
+	struct v4l2_format *f = &inst->fmts[is_decode_session(inst) ?
+		OUTPUT_PORT : INPUT_PORT].v4l2_fmt;
+
+	return NUM_MBS_PER_FRAME(f->fmt.pix_mp.height, f->fmt.pix_mp.width);
+}
+
+static inline bool is_vpp_delay_allowed(struct msm_vidc_inst *inst)
+{
+	return is_decode_session(inst) &&
+		get_v4l2_codec(inst) != V4L2_PIX_FMT_MPEG2;
+}
+
+#endif
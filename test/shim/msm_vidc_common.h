@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+#ifndef _MSM_VIDC_COMMON_H_
+#define _MSM_VIDC_COMMON_H_
+
+#include "vidc_test_shim.h"
+
+#define HEIC_GRID_DIMENSION 512
+
+static inline bool is_thumbnail_session(struct msm_vidc_inst *inst)
+{
+	return !!(inst->flags & VIDC_THUMBNAIL);
+}
+
+static inline bool is_secure_session(struct msm_vidc_inst *inst)
+{
+	return !!(inst->flags & VIDC_SECURE);
+}
+
+static inline struct v4l2_ctrl *get_ctrl(struct msm_vidc_inst *inst,
+	u32 id)
+{
+	u32 i;
+
+	for (i = 0; i < inst->num_ctrls; i++)
+		if (inst->ctrls[i].id == id)
+			return &inst->ctrls[i];
+	assert(!"control id not found");
+	return &inst->ctrls[0];
+}
+
+static inline bool is_decode_session(struct msm_vidc_inst *inst)
+{
+	return inst->session_type == MSM_VIDC_DECODER;
+}
+
+static inline bool is_encode_session(struct msm_vidc_inst *inst)
+{
+	return inst->session_type == MSM_VIDC_ENCODER;
+}
+
+static inline u32 get_v4l2_codec(struct msm_vidc_inst *inst)
+{
+	u32 port = is_decode_session(inst) ? INPUT_PORT : OUTPUT_PORT;
+
+	return inst->fmts[port].v4l2_fmt.fmt.pix_mp.pixelformat;
+}
+
+static inline bool is_image_session(struct msm_vidc_inst *inst)
+{
+	return is_encode_session(inst) &&
+		get_v4l2_codec(inst) == V4L2_PIX_FMT_HEVC &&
+		inst->rc_type == V4L2_MPEG_VIDEO_BITRATE_MODE_CQ;
+}
+
+static inline bool is_grid_session(struct msm_vidc_inst *inst)
+{
+	if (is_encode_session(inst) &&
+		get_v4l2_codec(inst) == V4L2_PIX_FMT_HEVC)
+		return get_ctrl(inst, V4L2_CID_MPEG_VIDC_IMG_GRID_SIZE)->val > 0;
+	return false;
+}
+
+static inline bool is_heif_decoder(struct msm_vidc_inst *inst)
+{
+	if (is_decode_session(inst) &&
+		get_v4l2_codec(inst) == V4L2_PIX_FMT_HEVC)
+		return get_ctrl(inst, V4L2_CID_MPEG_VIDC_VDEC_HEIF_MODE)->val > 0;
+	return false;
+}
+
+static inline bool is_realtime_session(struct msm_vidc_inst *inst)
+{
+	return !!get_ctrl(inst, V4L2_CID_MPEG_VIDC_VIDEO_PRIORITY)->val;
+}
+
+static inline bool is_secondary_output_mode(struct msm_vidc_inst *inst)
+{
+	return inst->stream_output_mode == HAL_VIDEO_DECODER_SECONDARY;
+}
+
+static inline bool is_hier_b_session(struct msm_vidc_inst *inst)
+{
+	struct v4l2_ctrl *max_layer, *frame_t;
+
+	if (!is_encode_session(inst))
+		return false;
+	max_layer = get_ctrl(inst,
+		V4L2_CID_MPEG_VIDC_VIDEO_HEVC_MAX_HIER_CODING_LAYER);
+	frame_t = get_ctrl(inst, V4L2_CID_MPEG_VIDEO_HEVC_HIER_CODING_TYPE);
+	return get_v4l2_codec(inst) == V4L2_PIX_FMT_HEVC &&
+		max_layer->val > 1 &&
+		frame_t->val == V4L2_MPEG_VIDEO_HEVC_HIERARCHICAL_CODING_B;
+}
+
+static inline bool vidc_scalar_enabled(struct msm_vidc_inst *inst)
+{
+	return inst->downscale;
+}
+
+static inline u32 msm_comm_convert_color_fmt(u32 v4l2_fmt, u32 sid)
+{
+	return v4l2_fmt;
+}
+
+/* uapi/vidc/media/msm_media_info.h, only reached by the frame size paths */
+static inline u32 VENUS_BUFFER_SIZE(u32 color_fmt, u32 width, u32 height)
+{
+	return ALIGN(width, 128) * ALIGN(height, 32) * 3 / 2;
+}
+
+static inline u32 VENUS_EXTRADATA_SIZE(u32 width, u32 height)
+{
+	return 16 * 1024;
+}
+
+#endif
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+#ifndef __H_MSM_VIDC_DEBUG_H__
+#define __H_MSM_VIDC_DEBUG_H__
+
+#include "vidc_test_shim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define d_vpr_e(__fmt, ...) do { } while (0)
+#define s_vpr_e(sid, __fmt, ...) do { (void)(sid); } while (0)
+#define s_vpr_h(sid, __fmt, ...) do { (void)(sid); } while (0)
+
+extern int msm_vidc_vpp_delay;
+extern bool msm_vidc_adaptive_bitstream;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,363 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ */
+
+/*
+ * Host build shims for the msm_vidc sources under test: the handful of
+ * kernel, v4l2 and driver definitions those sources use, reduced to the
+ * fields they touch. Control ids and fourccs only need to be distinct.
+ */
+
+#ifndef __H_VIDC_TEST_SHIM_H__
+#define __H_VIDC_TEST_SHIM_H__
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+typedef uint32_t __u32;
+
+#define EINVAL 22
+#define BIT(n) (1u << (n))
+#define SZ_4K 0x00001000
+#define SZ_256K 0x00040000
+
+#define ALIGN(x, a) (((x) + ((a) - 1)) & ~((__typeof__(x))(a) - 1))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max_t(type, a, b) max((type)(a), (type)(b))
+#define min_t(type, a, b) min((type)(a), (type)(b))
+#define div_u64(a, b) ((u64)(a) / (u32)(b))
+
+struct mutex {
+	int held;
+};
+
+static inline void mutex_lock(struct mutex *lock)
+{
+	assert(!lock->held);
+	lock->held = 1;
+}
+
+static inline void mutex_unlock(struct mutex *lock)
+{
+	assert(lock->held);
+	lock->held = 0;
+}
+
+/* v4l2 */
+#define v4l2_fourcc(a, b, c, d) \
+	((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+#define V4L2_PIX_FMT_H264 v4l2_fourcc('H', '2', '6', '4')
+#define V4L2_PIX_FMT_HEVC v4l2_fourcc('H', 'E', 'V', 'C')
+#define V4L2_PIX_FMT_VP8 v4l2_fourcc('V', 'P', '8', '0')
+#define V4L2_PIX_FMT_VP9 v4l2_fourcc('V', 'P', '9', '0')
+#define V4L2_PIX_FMT_MPEG2 v4l2_fourcc('M', 'G', '2', 'G')
+#define V4L2_PIX_FMT_NV12_UBWC v4l2_fourcc('Q', '1', '2', '8')
+
+enum vidc_test_ctrl_id {
+	V4L2_CID_ROTATE = 1,
+	V4L2_CID_HFLIP,
+	V4L2_CID_VFLIP,
+	V4L2_CID_MPEG_VIDEO_B_FRAMES,
+	V4L2_CID_MPEG_VIDC_VIDEO_LTRCOUNT,
+	V4L2_CID_MPEG_VIDEO_HEVC_HIER_CODING_TYPE,
+	V4L2_CID_MPEG_VIDC_VIDEO_HEVC_MAX_HIER_CODING_LAYER,
+	V4L2_CID_MPEG_VIDC_IMG_GRID_SIZE,
+	V4L2_CID_MPEG_VIDC_VDEC_HEIF_MODE,
+	V4L2_CID_MPEG_VIDC_VIDEO_PRIORITY,
+	VIDC_TEST_CTRL_MAX,
+};
+
+enum {
+	V4L2_MPEG_VIDEO_BITRATE_MODE_VBR = 0,
+	V4L2_MPEG_VIDEO_BITRATE_MODE_CBR,
+	V4L2_MPEG_VIDEO_BITRATE_MODE_MBR,
+	V4L2_MPEG_VIDEO_BITRATE_MODE_MBR_VFR,
+	V4L2_MPEG_VIDEO_BITRATE_MODE_CBR_VFR,
+	V4L2_MPEG_VIDEO_BITRATE_MODE_CQ,
+};
+
+#define V4L2_MPEG_VIDEO_HEVC_HIERARCHICAL_CODING_B 0
+#define V4L2_MPEG_VIDEO_HEVC_HIERARCHICAL_CODING_P 1
+
+struct v4l2_ctrl {
+	u32 id;
+	s32 val;
+};
+
+struct v4l2_pix_format_mplane {
+	u32 width;
+	u32 height;
+	u32 pixelformat;
+};
+
+struct v4l2_format {
+	u32 type;
+	union {
+		struct v4l2_pix_format_mplane pix_mp;
+	} fmt;
+};
+
+/* uapi/vidc/media/msm_vidc_utils.h */
+#define MSM_VIDC_BIT_DEPTH_8 0
+#define MSM_VIDC_BIT_DEPTH_10 1
+#define MSM_VIDC_PIC_STRUCT_MAYBE_INTERLACED 0x0
+#define MSM_VIDC_PIC_STRUCT_PROGRESSIVE 0x1
+
+enum msm_vidc_extradata_type {
+	EXTRADATA_NONE = 0,
+	EXTRADATA_DEFAULT = 1,
+	EXTRADATA_ADVANCED = 2,
+	EXTRADATA_ENC_INPUT_ROI = 4,
+	EXTRADATA_ENC_INPUT_HDR10PLUS = 8,
+	EXTRADATA_ENC_INPUT_CVP = 16,
+	EXTRADATA_ENC_FRAME_QP = 32,
+};
+
+struct msm_vidc_extradata_header {
+	__u32 size;
+	__u32 version;
+	__u32 port_index;
+	__u32 type;
+	__u32 data_size;
+	__u32 data[1];
+};
+
+struct msm_vidc_frame_qp_payload {
+	__u32 frame_qp;
+	__u32 qp_sum;
+	__u32 skip_qp_sum;
+	__u32 skip_num_blocks;
+	__u32 total_num_blocks;
+};
+
+struct msm_vidc_enc_cvp_metadata_payload {
+	__u32 data[256];
+};
+
+struct msm_vidc_metadata_ltr_payload {
+	__u32 ltr_use_mark;
+};
+
+/* msm_vidc.h */
+#define HAL_BUFFER_MAX 0xe
+
+enum hal_buffer {
+	HAL_BUFFER_NONE = 0x0,
+	HAL_BUFFER_INPUT = 0x1,
+	HAL_BUFFER_OUTPUT = 0x2,
+	HAL_BUFFER_OUTPUT2 = 0x4,
+	HAL_BUFFER_EXTRADATA_INPUT = 0x8,
+	HAL_BUFFER_EXTRADATA_OUTPUT = 0x10,
+	HAL_BUFFER_EXTRADATA_OUTPUT2 = 0x20,
+	HAL_BUFFER_INTERNAL_SCRATCH = 0x40,
+	HAL_BUFFER_INTERNAL_SCRATCH_1 = 0x80,
+	HAL_BUFFER_INTERNAL_SCRATCH_2 = 0x100,
+	HAL_BUFFER_INTERNAL_PERSIST = 0x200,
+	HAL_BUFFER_INTERNAL_PERSIST_1 = 0x400,
+	HAL_BUFFER_INTERNAL_CMD_QUEUE = 0x800,
+	HAL_BUFFER_INTERNAL_RECON = 0x1000,
+};
+
+enum session_type {
+	MSM_VIDC_ENCODER = 0,
+	MSM_VIDC_DECODER,
+	MSM_VIDC_UNKNOWN,
+};
+
+/* vidc_hfi_helper.h */
+#define HFI_WORKMODE_1 0x1
+#define HFI_WORKMODE_2 0x2
+
+/* vidc_hfi_api.h */
+enum hal_video_codec {
+	HAL_VIDEO_DECODER_PRIMARY = 0x1,
+	HAL_VIDEO_DECODER_SECONDARY = 0x2,
+};
+
+struct hal_buffer_requirements {
+	enum hal_buffer buffer_type;
+	u32 buffer_size;
+	u16 buffer_count_min;
+	u16 buffer_count_min_host;
+	u16 buffer_count_actual;
+	u16 buffer_alignment;
+};
+
+struct buffer_requirements {
+	struct hal_buffer_requirements buffer[HAL_BUFFER_MAX];
+};
+
+/* msm_vidc_internal.h */
+#define SINGLE_INPUT_BUFFER 1
+#define SINGLE_OUTPUT_BUFFER 1
+#define MAX_BSE_VPP_DELAY 6
+#define RATE_CONTROL_OFF (V4L2_MPEG_VIDEO_BITRATE_MODE_CQ + 1)
+#define RATE_CONTROL_LOSSLESS (V4L2_MPEG_VIDEO_BITRATE_MODE_CQ + 2)
+
+#define NUM_MBS_PER_FRAME(__height, __width) \
+	((ALIGN(__height, 16) / 16) * (ALIGN(__width, 16) / 16))
+
+enum instance_state {
+	MSM_VIDC_CORE_UNINIT_DONE = 0x0001,
+	MSM_VIDC_OPEN_DONE = 0x0006,
+	MSM_VIDC_START_DONE = 0x000C,
+	MSM_VIDC_STOP_DONE = 0x000E,
+};
+
+enum vidc_ports {
+	INPUT_PORT,
+	OUTPUT_PORT,
+	MAX_PORT_NUM
+};
+
+enum vpu_version {
+	VPU_VERSION_AR50 = 1,
+	VPU_VERSION_IRIS1,
+	VPU_VERSION_IRIS2,
+	VPU_VERSION_IRIS2_1,
+	VPU_VERSION_AR50_LITE,
+};
+
+enum hal_capability {
+	CAP_MBS_PER_FRAME,
+	CAP_MAX,
+};
+
+struct msm_vidc_codec_capability {
+	u32 min;
+	u32 max;
+};
+
+struct msm_vidc_capability {
+	struct msm_vidc_codec_capability cap[CAP_MAX];
+};
+
+struct msm_vidc_format {
+	u32 count_min;
+	u32 count_min_host;
+	u32 count_actual;
+	struct v4l2_format v4l2_fmt;
+};
+
+#define MSM_VIDC_BUF_SIZE_CACHE_ENTRIES 8
+
+struct msm_vidc_buf_size_key {
+	u32 session_type;
+	u32 fourcc;
+	u32 width;
+	u32 height;
+	u32 num_vpp_pipes;
+	u32 interlaced;
+	u32 vpp_delay;
+	u32 out_min_count;
+	u32 split_mode;
+	u32 work_mode;
+	u32 num_ref;
+	u32 ten_bit;
+	u32 downscale;
+	u32 rotation;
+	u32 flip;
+	u32 rc_type;
+	u32 grid;
+	u32 image;
+	u32 bitstream_size;
+};
+
+struct msm_vidc_buf_size_entry {
+	bool valid;
+	struct msm_vidc_buf_size_key key;
+	u32 scratch;
+	u32 scratch1;
+	u32 scratch2;
+	u32 persist;
+};
+
+struct msm_vidc_buf_size_cache {
+	struct mutex lock;
+	struct msm_vidc_buf_size_entry entries[MSM_VIDC_BUF_SIZE_CACHE_ENTRIES];
+	u32 next;
+	u32 hits;
+	u32 misses;
+};
+
+struct msm_vidc_platform_data {
+	u32 vpu_ver;
+	u32 num_vpp_pipes;
+};
+
+struct msm_vidc_platform_resources {
+	bool dcvs;
+};
+
+struct msm_vidc_core {
+	struct msm_vidc_platform_data *platform_data;
+	struct msm_vidc_platform_resources resources;
+	struct msm_vidc_buf_size_cache buf_size_cache;
+};
+
+struct clock_data {
+	u32 work_mode;
+};
+
+struct batch_mode {
+	bool enable;
+};
+
+struct msm_vidc_inst_prop {
+	u32 extradata_ctrls;
+};
+
+struct msm_vidc_bitstream_stats {
+	u32 frames;
+	u32 max_filled_len;
+	u32 mbs;
+	bool overflow;
+};
+
+#define VIDC_SECURE BIT(0)
+#define VIDC_THUMBNAIL BIT(1)
+
+struct msm_vidc_inst {
+	struct msm_vidc_core *core;
+	enum session_type session_type;
+	enum instance_state state;
+	u32 sid;
+	u32 flags;
+	struct msm_vidc_format fmts[MAX_PORT_NUM];
+	struct buffer_requirements buff_req;
+	struct msm_vidc_capability capability;
+	struct msm_vidc_inst_prop prop;
+	struct clock_data clk_data;
+	struct batch_mode batch;
+	struct msm_vidc_bitstream_stats bitstream_stats;
+	struct v4l2_ctrl ctrls[VIDC_TEST_CTRL_MAX];
+	u32 num_ctrls;
+	u32 rc_type;
+	u32 bit_depth;
+	u32 pic_struct;
+	u32 bse_vpp_delay;
+	u32 stream_output_mode;
+	bool hybrid_hp;
+	bool downscale;
+	int (*buffer_size_calculators)(struct msm_vidc_inst *inst);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif